@@ -133,6 +133,22 @@ public:
 			This_Code_Should_Never_Get_Compiled_!
 		#endif	
 	}
+
+	// Copies up to count primitives given to copyData back to outData, and
+	// returns how many were copied
+	int readData(T* outData, int count) {
+		int c = (count < this->numPrims_) ? count : this->numPrims_;
+
+		#if defined(__PIKOC_PTX__)
+			CUDACHECK(cuMemcpyDtoH(outData, this->data_,
+				c*sizeof(T)));
+		#elif defined(__PIKOC_CPU__)
+			memcpy(outData, this->data_, c*sizeof(T));
+		#else
+			This_Code_Should_Never_Get_Compiled_!
+		#endif
+		return c;
+	}
 #endif // ndef __PIKOC_ANALYSIS_PHASE__
 #endif // __PIKOC_HOST__
 
@@ -167,6 +183,13 @@ public:
 	}
 
 
+	// for bins that only one thread fetches from, see PIKO_EXCLUSIVE_BINS
+	T fetchPrimExclusive() {
+		int pos = this->head_++ % this->maxPrims_;
+
+		return this->data_[pos];
+	}
+
 	T fetchPrim(int pos) {
 		return this->data_[pos];
 	}
@@ -1,6 +1,11 @@
 #ifndef GLOBAL_VARIABLES_H
 #define GLOBAL_VARIABLES_H
 
+// Defined by the device object when one is linked with the host code
+#ifdef __PIKOC_DEVICE_EXTERN__
+extern int overrideBinID;
+#else
 int overrideBinID = -1;
+#endif
 
 #endif // GLOBAL_VARIABLES_H
@@ -0,0 +1,173 @@
+#ifndef PIKO_BENCH_H
+#define PIKO_BENCH_H
+
+// Host-side recorder used by pipelines built with pikoc --bench.
+// The generated run functions add the wall time of every kernel to the stage
+// it belongs to; the benchmark harness marks the frames with beginFrame() and
+// endFrame(), and gets per-frame and per-stage statistics back.
+
+#if defined(__PIKOC_HOST__) && !defined(__PIKOC_ANALYSIS_PHASE__)
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "piko/timer.h"
+
+struct PikoBenchSummary {
+	int count;
+	double mean;
+	double median;
+	double p95;
+	double p99;
+	double stddev;
+	double min;
+	double max;
+};
+
+// Summary statistics of a list of samples. Percentiles use the nearest-rank
+// method, so they are always one of the measured values.
+inline PikoBenchSummary pikoSummarize(std::vector<double> samples) {
+	PikoBenchSummary s;
+	s.count = samples.size();
+	s.mean = s.median = s.p95 = s.p99 = s.stddev = s.min = s.max = 0.0;
+	if(samples.empty())
+		return s;
+
+	std::sort(samples.begin(), samples.end());
+
+	double sum = 0.0;
+	for(unsigned i = 0; i < samples.size(); ++i)
+		sum += samples[i];
+	s.mean = sum / s.count;
+
+	double var = 0.0;
+	for(unsigned i = 0; i < samples.size(); ++i)
+		var += (samples[i] - s.mean) * (samples[i] - s.mean);
+	s.stddev = (s.count > 1) ? sqrt(var / (s.count - 1)) : 0.0;
+
+	int n = s.count;
+	s.median = (n % 2) ? samples[n / 2] : 0.5 * (samples[n / 2 - 1] + samples[n / 2]);
+	s.p95 = samples[std::min(n - 1, (int) ceil(0.95 * n) - 1)];
+	s.p99 = samples[std::min(n - 1, (int) ceil(0.99 * n) - 1)];
+	s.min = samples.front();
+	s.max = samples.back();
+	return s;
+}
+
+// Writes a summary as one JSON object, e.g. for the results file of a
+// benchmark harness
+inline void pikoWriteSummaryJSON(FILE* f, const PikoBenchSummary& s) {
+	fprintf(f, "{ \"mean\": %f, \"median\": %f, \"p95\": %f, \"p99\": %f,"
+		" \"stddev\": %f, \"min\": %f, \"max\": %f }",
+		s.mean, s.median, s.p95, s.p99, s.stddev, s.min, s.max);
+}
+
+class PikoBenchRecorder {
+public:
+	PikoBenchRecorder()
+		: frameStart_(0.0)
+		, start_(0.0)
+	{}
+
+	void reset() {
+		stageNames_.clear();
+		stageFrame_.clear();
+		stageSamples_.clear();
+		frameSamples_.clear();
+	}
+
+	void addStage(const char* name) {
+		stageNames_.push_back(name);
+		stageFrame_.push_back(0.0);
+		stageSamples_.push_back(std::vector<double>());
+	}
+
+	// Drop everything measured so far, e.g. after the warm-up frames
+	void discard() {
+		frameSamples_.clear();
+		for(unsigned i = 0; i < stageSamples_.size(); ++i) {
+			stageFrame_[i] = 0.0;
+			stageSamples_[i].clear();
+		}
+	}
+
+	void beginFrame() {
+		for(unsigned i = 0; i < stageFrame_.size(); ++i)
+			stageFrame_[i] = 0.0;
+		pikoDeviceSync();
+		frameStart_ = pikoWallTimeMs();
+	}
+
+	void endFrame() {
+		pikoDeviceSync();
+		frameSamples_.push_back(pikoWallTimeMs() - frameStart_);
+		for(unsigned i = 0; i < stageFrame_.size(); ++i)
+			stageSamples_[i].push_back(stageFrame_[i]);
+	}
+
+	void startTimer() {
+		pikoDeviceSync();
+		start_ = pikoWallTimeMs();
+	}
+
+	// Fused kernels are attributed to the first stage they run
+	void stopTimer(int stage, PikoPhase phase) {
+		pikoDeviceSync();
+		stageFrame_[stage] += pikoWallTimeMs() - start_;
+	}
+
+	int getNumStages() const { return stageNames_.size(); }
+	const char* getStageName(int stage) const { return stageNames_[stage].c_str(); }
+	int getNumFrames() const { return frameSamples_.size(); }
+
+	PikoBenchSummary frameSummary() const { return pikoSummarize(frameSamples_); }
+	PikoBenchSummary stageSummary(int stage) const { return pikoSummarize(stageSamples_[stage]); }
+
+	void print() const {
+		printf("%-24s %9s %9s %9s %9s %9s\n", "(msec)", "mean", "median", "p95", "p99", "stddev");
+		printSummary("frame", frameSummary());
+		for(int i = 0; i < getNumStages(); ++i)
+			printSummary(getStageName(i), stageSummary(i));
+	}
+
+	// Writes the results as one JSON object. `info` is copied as-is into the
+	// object, so it must be a list of members such as "\"scene\": \"a.scene\""
+	// or empty. Results of several runs can be collected in a JSON array.
+	void writeJSON(FILE* f, const char* pipeName, const std::string& info) const {
+		fprintf(f, "{\n");
+		fprintf(f, "  \"pipe\": \"%s\",\n", pipeName);
+		if(info != "")
+			fprintf(f, "  %s,\n", info.c_str());
+		fprintf(f, "  \"frames\": %d,\n", getNumFrames());
+		fprintf(f, "  \"frame_ms\": ");
+		pikoWriteSummaryJSON(f, frameSummary());
+		fprintf(f, ",\n");
+		fprintf(f, "  \"stages\": [\n");
+		for(int i = 0; i < getNumStages(); ++i) {
+			fprintf(f, "    { \"name\": \"%s\", \"ms\": ", getStageName(i));
+			pikoWriteSummaryJSON(f, stageSummary(i));
+			fprintf(f, " }%s\n", (i + 1 < getNumStages()) ? "," : "");
+		}
+		fprintf(f, "  ]\n");
+		fprintf(f, "}");
+	}
+
+private:
+	static void printSummary(const char* name, const PikoBenchSummary& s) {
+		printf("%-24s %9.3f %9.3f %9.3f %9.3f %9.3f\n",
+			name, s.mean, s.median, s.p95, s.p99, s.stddev);
+	}
+
+	std::vector<std::string> stageNames_;
+	std::vector<double> stageFrame_;
+	std::vector< std::vector<double> > stageSamples_;
+	std::vector<double> frameSamples_;
+	double frameStart_;
+	double start_;
+};
+
+#endif // __PIKOC_HOST__ && !__PIKOC_ANALYSIS_PHASE__
+#endif // PIKO_BENCH_H
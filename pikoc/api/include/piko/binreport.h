@@ -0,0 +1,263 @@
+#ifndef PIKO_BINREPORT_H
+#define PIKO_BINREPORT_H
+
+// Bin occupancy report of pipelines built with pikoc --bin-report.
+// Before every stage is scheduled, the generated run functions add the
+// number of primitives in each of its bins to the current frame. At the end
+// of a frame the recorder computes, for every stage, a histogram of bin
+// occupancy, the max/mean imbalance and the hottest bins with their screen
+// rectangles. destroy() writes the report of the last frame, and imbalance
+// averaged over all frames, to <prefix>.txt, and with --bin-heatmap a PPM
+// image of the bin load of every binned stage to <prefix>_<stage>.ppm.
+
+#if defined(__PIKOC_HOST__) && !defined(__PIKOC_ANALYSIS_PHASE__)
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Bucket 0 counts empty bins, bucket b > 0 counts bins holding
+// [2^(b-1), 2^b) primitives. The last bucket is open ended.
+#define PIKO_BINREPORT_HIST_BUCKETS 16
+
+// Number of hottest bins listed per stage
+#ifndef PIKO_BINREPORT_TOPK
+	#define PIKO_BINREPORT_TOPK 8
+#endif
+
+struct PikoHotBin {
+	int bin;
+	long long prims;
+	int x, y, w, h;   // screen rectangle of the bin
+};
+
+struct PikoStageBinReport {
+	std::string name;
+	int numBins;
+	int numBinsX, numBinsY;
+	int binSizeX, binSizeY;   // 0 for a single full-screen bin
+
+	// last completed frame
+	long long prims;
+	int activeBins;
+	long long maxBinPrims;
+	double meanBinPrims;      // over active bins
+	double imbalance;         // max / mean, 1 when perfectly balanced
+	long long hist[PIKO_BINREPORT_HIST_BUCKETS];
+	std::vector<PikoHotBin> hottest;
+	std::vector<long long> load;
+
+	// over all completed frames
+	double imbalanceSum;
+	int frames;
+
+	// frame in progress
+	std::vector<long long> current;
+};
+
+class PikoBinReportRecorder {
+public:
+	void reset() {
+		stages_.clear();
+	}
+
+	void addStage(const char* name) {
+		PikoStageBinReport s;
+		s.name = name;
+		s.numBins = 0;
+		s.numBinsX = s.numBinsY = 0;
+		s.binSizeX = s.binSizeY = 0;
+		s.imbalanceSum = 0.0;
+		s.frames = 0;
+		clearFrame(s);
+		stages_.push_back(s);
+	}
+
+	template <class StageType>
+	void recordBins(int stage, StageType& stg) {
+		PikoStageBinReport& s = stages_[stage];
+		s.numBins = stg.getNumBins();
+		s.numBinsX = stg.getNumBinsX();
+		s.numBinsY = stg.getNumBinsY();
+		s.binSizeX = stg.getBinSizeX();
+		s.binSizeY = stg.getBinSizeY();
+		addBins(s, stg.getBin(0));
+	}
+
+	// Stages that were not scheduled in this frame keep their last report
+	void endFrame() {
+		for(unsigned i = 0; i < stages_.size(); ++i) {
+			PikoStageBinReport& s = stages_[i];
+			if(s.current.empty())
+				continue;
+			summarize(s);
+			s.current.clear();
+		}
+	}
+
+	int getNumStages() const { return stages_.size(); }
+	const PikoStageBinReport& getStage(int stage) const { return stages_[stage]; }
+
+	void print(FILE* f) const {
+		for(unsigned i = 0; i < stages_.size(); ++i) {
+			const PikoStageBinReport& s = stages_[i];
+			if(s.frames == 0)
+				continue;
+
+			fprintf(f, "stage %s: %d bins (%dx%d of %dx%d pixels)\n", s.name.c_str(),
+				s.numBins, s.numBinsX, s.numBinsY, s.binSizeX, s.binSizeY);
+			fprintf(f, "  last frame: %lld prims in %d active bins, mean %.1f, max %lld,"
+				" imbalance %.2f\n", s.prims, s.activeBins, s.meanBinPrims, s.maxBinPrims,
+				s.imbalance);
+			fprintf(f, "  mean imbalance over %d frames: %.2f\n", s.frames,
+				s.imbalanceSum / s.frames);
+
+			fprintf(f, "  occupancy histogram (prims: bins):");
+			const char* sep = " ";
+			for(int b = 0; b < PIKO_BINREPORT_HIST_BUCKETS; ++b) {
+				if(s.hist[b] == 0)
+					continue;
+				if(b == 0)
+					fprintf(f, "%s0: %lld", sep, s.hist[b]);
+				else
+					fprintf(f, "%s%lld-%lld: %lld", sep, 1LL << (b - 1), (1LL << b) - 1, s.hist[b]);
+				sep = ", ";
+			}
+			fprintf(f, "\n");
+
+			fprintf(f, "  hottest bins:\n");
+			for(unsigned k = 0; k < s.hottest.size(); ++k) {
+				const PikoHotBin& h = s.hottest[k];
+				fprintf(f, "    bin %6d  %8lld prims  at (%d, %d) size %dx%d\n",
+					h.bin, h.prims, h.x, h.y, h.w, h.h);
+			}
+		}
+	}
+
+	bool write(const char* prefix, bool heatmaps) const {
+		std::string filename = std::string(prefix) + ".txt";
+		FILE* f = fopen(filename.c_str(), "w");
+		if(!f) {
+			printf("Unable to write bin report %s\n", filename.c_str());
+			return false;
+		}
+		print(f);
+		fclose(f);
+		printf("Wrote bin report to %s\n", filename.c_str());
+
+		if(heatmaps) {
+			for(unsigned i = 0; i < stages_.size(); ++i)
+				writeHeatmap(prefix, stages_[i]);
+		}
+		return true;
+	}
+
+private:
+	static void clearFrame(PikoStageBinReport& s) {
+		s.prims = 0;
+		s.activeBins = 0;
+		s.maxBinPrims = 0;
+		s.meanBinPrims = 0.0;
+		s.imbalance = 1.0;
+		for(int b = 0; b < PIKO_BINREPORT_HIST_BUCKETS; ++b)
+			s.hist[b] = 0;
+		s.hottest.clear();
+	}
+
+	// A stage inside a loop is scheduled several times in a frame: its
+	// occupancy adds up
+	template <class BinType>
+	static void addBins(PikoStageBinReport& s, BinType* bins) {
+		if(s.current.size() != (unsigned) s.numBins)
+			s.current.assign(s.numBins, 0);
+		for(int i = 0; i < s.numBins; ++i)
+			s.current[i] += bins[i].getNumPrims();
+	}
+
+	static void summarize(PikoStageBinReport& s) {
+		clearFrame(s);
+		s.load = s.current;
+
+		for(int i = 0; i < s.numBins; ++i) {
+			long long n = s.load[i];
+			s.prims += n;
+			if(n > 0)
+				s.activeBins += 1;
+			s.maxBinPrims = std::max(s.maxBinPrims, n);
+
+			int b = 0;
+			while(n > 0 && b < PIKO_BINREPORT_HIST_BUCKETS - 1) {
+				n >>= 1;
+				++b;
+			}
+			s.hist[b] += 1;
+		}
+
+		if(s.activeBins > 0) {
+			s.meanBinPrims = (double) s.prims / s.activeBins;
+			s.imbalance = s.maxBinPrims / s.meanBinPrims;
+		}
+		s.imbalanceSum += s.imbalance;
+		s.frames += 1;
+
+		std::vector< std::pair<long long, int> > order;
+		for(int i = 0; i < s.numBins; ++i) {
+			if(s.load[i] > 0)
+				order.push_back(std::make_pair(-s.load[i], i));
+		}
+		int k = std::min((int) order.size(), PIKO_BINREPORT_TOPK);
+		std::partial_sort(order.begin(), order.begin() + k, order.end());
+
+		for(int i = 0; i < k; ++i) {
+			PikoHotBin h;
+			h.bin = order[i].second;
+			h.prims = -order[i].first;
+			h.x = (h.bin % std::max(s.numBinsX, 1)) * s.binSizeX;
+			h.y = (h.bin / std::max(s.numBinsX, 1)) * s.binSizeY;
+			h.w = s.binSizeX;
+			h.h = s.binSizeY;
+			s.hottest.push_back(h);
+		}
+	}
+
+	// One pixel per screen pixel, rows from the top of the screen. Load is
+	// scaled to the hottest bin: black (empty), red, yellow, white (hottest).
+	static void writeHeatmap(const char* prefix, const PikoStageBinReport& s) {
+		if(s.frames == 0 || s.binSizeX == 0 || s.binSizeY == 0 || s.numBins <= 1)
+			return;
+
+		std::string filename = std::string(prefix) + "_" + s.name + ".ppm";
+		FILE* f = fopen(filename.c_str(), "wb");
+		if(!f) {
+			printf("Unable to write bin heatmap %s\n", filename.c_str());
+			return;
+		}
+
+		int W = s.numBinsX * s.binSizeX;
+		int H = s.numBinsY * s.binSizeY;
+		fprintf(f, "P6\n%d %d\n255\n", W, H);
+
+		std::vector<unsigned char> row(3 * W);
+		for(int y = H - 1; y >= 0; --y) {
+			int by = y / s.binSizeY;
+			for(int x = 0; x < W; ++x) {
+				int bin = by * s.numBinsX + x / s.binSizeX;
+				double t = (s.maxBinPrims > 0) ? (double) s.load[bin] / s.maxBinPrims : 0.0;
+				double v = 3.0 * t;
+				row[3*x + 0] = (unsigned char) (255.0 * std::min(v, 1.0));
+				row[3*x + 1] = (unsigned char) (255.0 * std::min(std::max(v - 1.0, 0.0), 1.0));
+				row[3*x + 2] = (unsigned char) (255.0 * std::min(std::max(v - 2.0, 0.0), 1.0));
+			}
+			fwrite(&row[0], 1, row.size(), f);
+		}
+
+		fclose(f);
+		printf("Wrote bin heatmap to %s\n", filename.c_str());
+	}
+
+	std::vector<PikoStageBinReport> stages_;
+};
+
+#endif // __PIKOC_HOST__ && !__PIKOC_ANALYSIS_PHASE__
+#endif // PIKO_BINREPORT_H
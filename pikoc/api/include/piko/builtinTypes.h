@@ -27,14 +27,46 @@ struct ConstantState
 	float projMatrix[16];
 	float viewMatrix[16];
 	float viewProjMatrix[16];
+	cvec3f eyePos; // camera position, for lighting in the pipeline
   int debX, debY;
 
 	void isConstantState() {}
 };
 
+// Side of the square pixel tiles of MutableState::hizBuffer
+#define PIKO_HIZ_TILE_LG2 3
+#define PIKO_HIZ_TILE (1 << PIKO_HIZ_TILE_LG2)
+
+// The per-pixel buffers are sized to the screen of the ConstantState when
+// they are allocated (see piko/mutableState.h)
 struct MutableState
 {
-  float zBuffer[1024*768];
+  // The depth of every pixel, in the layout of piko/screen.h
+  float* zBuffer;
+
+  // An upper bound of the depths of every tile of zBuffer, row by row, as
+  // the signed ints of their float bits that depth tests compare
+  int* hizBuffer;
+
+  // The id of the primitive visible at every pixel, for pipelines that shade
+  // after visibility is resolved. The host clears it every frame like zBuffer,
+  // or leaves it NULL if the pipeline does not use it (see
+  // pikoAllocateMutableState()); the device then has no copy of it.
+  int* visBuffer;
+
+  // The transformed vertices of indexed input, for pipelines that transform
+  // every vertex once before assembling primitives: numVertices vertices of
+  // vertexBytes each. The host sets both before allocate() and leaves the
+  // buffer NULL; only the device has it.
+  void* vertexBuffer;
+  int numVertices;
+  int vertexBytes;
+
+  // Geometry the pipeline reads by index, like the vertices and triangles of
+  // meshlets: geometryBytes bytes that the host fills and owns. allocate()
+  // copies it to the device once (see pikoDeviceBufferStatic()).
+  void* geometryBuffer;
+  int geometryBytes;
 
   void isMutableState() {}
 };
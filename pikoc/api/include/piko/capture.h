@@ -0,0 +1,239 @@
+#ifndef PIKO_CAPTURE_H
+#define PIKO_CAPTURE_H
+
+// Frame input captures of pipelines built with pikoc --capture.
+// writeCapture(), which pikoc adds to the pipeline class, stores the
+// ConstantState, the MutableState with its from-host and static buffers (see
+// piko/mutableState.h) and the primitives of the input PikoArray in one
+// binary file. PikoCapture maps such a file back into memory, so that
+// a replay tool can hand it to allocate() and run prepare()/run_single()
+// without loading any scene assets.
+//
+// The states and primitives are stored as raw bytes: a capture can only be
+// replayed by a pipeline built from the same types, on the same platform.
+// open() checks their sizes, not their layout.
+
+#if defined(__PIKOC_HOST__) && !defined(__PIKOC_ANALYSIS_PHASE__)
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "piko/mutableState.h"
+
+#define PIKO_CAPTURE_MAGIC "PIKOCAP"
+#define PIKO_CAPTURE_VERSION 5
+
+// Sections start on cache-line boundaries of the mapping
+#define PIKO_CAPTURE_ALIGN 64
+
+struct PikoCaptureHeader {
+	char magic[8];
+	unsigned version;
+	unsigned constStateSize;
+	unsigned mutableStateSize;
+	unsigned primSize;
+	long long count;
+	long long constStateOffset;
+	long long mutableStateOffset;
+	long long buffersOffset;
+	long long inputOffset;
+	long long fileSize;
+};
+
+inline long long pikoCaptureAlign(long long offset) {
+	return (offset + PIKO_CAPTURE_ALIGN - 1) / PIKO_CAPTURE_ALIGN * PIKO_CAPTURE_ALIGN;
+}
+
+// Whether a capture stores buffer i of state: the pipeline fills the others
+template <class State>
+bool pikoCaptureStoresBuffer(const State& state, int i) {
+	return pikoDeviceBufferFromHost(state, i) || pikoDeviceBufferStatic(state, i);
+}
+
+// The device buffers of mutableState follow each other from offset on,
+// sized for the screen of constState. Buffers a capture does not store take
+// no space. Returns the end of the last one.
+template <class ConstantState, class MutableState>
+long long pikoCaptureDeviceBuffers(const ConstantState& constState,
+	const MutableState& mutableState, long long offset, std::vector<long long>& offsets)
+{
+	offsets.resize(pikoNumDeviceBuffers(mutableState));
+	for(size_t i = 0; i < offsets.size(); ++i) {
+		offsets[i] = pikoCaptureAlign(offset);
+		if(pikoCaptureStoresBuffer(mutableState, i))
+			offset = offsets[i] + pikoDeviceBufferBytes(mutableState, i,
+				constState.screenSizeX, constState.screenSizeY);
+	}
+	return offset;
+}
+
+// The gaps left by alignment read back as zeros
+inline bool pikoWriteCaptureSection(FILE* f, long long offset, const void* data, long long size) {
+	if(fseek(f, offset, SEEK_SET) != 0)
+		return false;
+	return size == 0 || fwrite(data, size, 1, f) == 1;
+}
+
+template <class ConstantState, class MutableState, class Prim>
+bool pikoWriteCapture(const char* filename, const ConstantState& constState,
+	const MutableState& mutableState, const Prim* input, int count)
+{
+	PikoCaptureHeader h;
+	memset(&h, 0, sizeof(h));
+	strncpy(h.magic, PIKO_CAPTURE_MAGIC, sizeof(h.magic));
+	h.version = PIKO_CAPTURE_VERSION;
+	h.constStateSize = sizeof(ConstantState);
+	h.mutableStateSize = sizeof(MutableState);
+	h.primSize = sizeof(Prim);
+	h.count = count;
+	h.constStateOffset = pikoCaptureAlign(sizeof(h));
+	h.mutableStateOffset = pikoCaptureAlign(h.constStateOffset + h.constStateSize);
+	h.buffersOffset = pikoCaptureAlign(h.mutableStateOffset + h.mutableStateSize);
+
+	std::vector<long long> bufferOffsets;
+	long long buffersEnd = pikoCaptureDeviceBuffers(constState, mutableState,
+		h.buffersOffset, bufferOffsets);
+
+	h.inputOffset = pikoCaptureAlign(buffersEnd);
+	h.fileSize = h.inputOffset + h.count * h.primSize;
+
+	FILE* f = fopen(filename, "wb");
+	if(!f) {
+		printf("Unable to write capture %s\n", filename);
+		return false;
+	}
+
+	bool ok = pikoWriteCaptureSection(f, 0, &h, sizeof(h))
+		&& pikoWriteCaptureSection(f, h.constStateOffset, &constState, h.constStateSize)
+		&& pikoWriteCaptureSection(f, h.mutableStateOffset, &mutableState, h.mutableStateSize)
+		&& pikoWriteCaptureSection(f, h.inputOffset, input, h.count * h.primSize);
+	for(size_t i = 0; ok && i < bufferOffsets.size(); ++i) {
+		const void* buffer = pikoGetDeviceBuffer(mutableState, i);
+		if(buffer != NULL && pikoCaptureStoresBuffer(mutableState, i))
+			ok = pikoWriteCaptureSection(f, bufferOffsets[i], buffer,
+				pikoDeviceBufferBytes(mutableState, i, constState.screenSizeX, constState.screenSizeY));
+	}
+	// the file spans fileSize even if it ends in an empty or skipped section
+	ok = ok && fflush(f) == 0 && ftruncate(fileno(f), h.fileSize) == 0;
+	fclose(f);
+
+	if(ok)
+		printf("Wrote capture of %d primitives to %s\n", count, filename);
+	else
+		printf("Unable to write capture %s\n", filename);
+	return ok;
+}
+
+class PikoCapture {
+public:
+	PikoCapture()
+		: data_(NULL)
+		, size_(0)
+	{}
+
+	~PikoCapture() { close(); }
+
+	// Maps the file copy-on-write: the pipeline may change the states it is
+	// given, which leaves the file untouched
+	template <class ConstantState, class MutableState, class Prim>
+	bool open(const char* filename) {
+		close();
+
+		int fd = ::open(filename, O_RDONLY);
+		if(fd < 0) {
+			printf("Unable to open capture %s\n", filename);
+			return false;
+		}
+
+		struct stat st;
+		if(fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(PikoCaptureHeader)) {
+			printf("%s is not a capture\n", filename);
+			::close(fd);
+			return false;
+		}
+
+		void* p = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+		::close(fd);
+		if(p == MAP_FAILED) {
+			printf("Unable to map capture %s\n", filename);
+			return false;
+		}
+		data_ = (char*) p;
+		size_ = st.st_size;
+
+		const PikoCaptureHeader& h = header();
+		if(strncmp(h.magic, PIKO_CAPTURE_MAGIC, sizeof(h.magic)) != 0
+			|| h.version != PIKO_CAPTURE_VERSION || h.fileSize > size_
+			|| h.constStateOffset < 0 || h.constStateOffset + h.constStateSize > size_
+			|| h.mutableStateOffset < 0 || h.mutableStateOffset + h.mutableStateSize > size_)
+		{
+			printf("%s is not a capture of version %d\n", filename, PIKO_CAPTURE_VERSION);
+			close();
+			return false;
+		}
+		if(h.constStateSize != sizeof(ConstantState)
+			|| h.mutableStateSize != sizeof(MutableState)
+			|| h.primSize != sizeof(Prim))
+		{
+			printf("%s was captured from a pipeline with different state or primitive types\n",
+				filename);
+			close();
+			return false;
+		}
+
+		// point the captured state at its buffers in the mapping
+		ConstantState& constState = *this->constState<ConstantState>();
+		MutableState& state = *mutableState<MutableState>();
+		std::vector<long long> bufferOffsets;
+		long long buffersEnd = pikoCaptureDeviceBuffers(constState, state,
+			h.buffersOffset, bufferOffsets);
+		if(buffersEnd > h.inputOffset || buffersEnd > size_)
+		{
+			printf("%s is not a capture of version %d\n", filename, PIKO_CAPTURE_VERSION);
+			close();
+			return false;
+		}
+		// buffers the captured host left NULL stay NULL
+		for(size_t i = 0; i < bufferOffsets.size(); ++i)
+			pikoSetDeviceBuffer(state, i, pikoCaptureStoresBuffer(state, i)
+				&& pikoGetDeviceBuffer(state, i) != NULL ? data_ + bufferOffsets[i] : NULL);
+		return true;
+	}
+
+	void close() {
+		if(data_ != NULL)
+			munmap(data_, size_);
+		data_ = NULL;
+		size_ = 0;
+	}
+
+	bool isOpen() const { return data_ != NULL; }
+
+	const PikoCaptureHeader& header() const { return *(const PikoCaptureHeader*) data_; }
+	int getCount() const { return header().count; }
+
+	template <class ConstantState>
+	ConstantState* constState() { return (ConstantState*) (data_ + header().constStateOffset); }
+
+	template <class MutableState>
+	MutableState* mutableState() { return (MutableState*) (data_ + header().mutableStateOffset); }
+
+	template <class Prim>
+	Prim* input() { return (Prim*) (data_ + header().inputOffset); }
+
+private:
+	PikoCapture(const PikoCapture&);
+	PikoCapture& operator=(const PikoCapture&);
+
+	char* data_;
+	long long size_;
+};
+
+#endif // __PIKOC_HOST__ && !__PIKOC_ANALYSIS_PHASE__
+#endif // PIKO_CAPTURE_H
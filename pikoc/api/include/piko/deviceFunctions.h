@@ -49,6 +49,11 @@ enum SchedulePolicy {
 
 void specifySchedule(SchedulePolicy pol, const int tileSplitSize=0) {}
 
+// Called in schedule(), declares that every bin of the stage is processed by
+// one thread at a time when pikoc cannot prove it from the schedule policy
+// (see PIKO_EXCLUSIVE_BINS in piko/stage.h)
+void specifyExclusiveBins() {}
+
 #if defined(__PIKOC_CPU__)
 	extern thread_local int threadIdx_x;
 	extern thread_local int blockIdx_x;
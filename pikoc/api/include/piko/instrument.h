@@ -0,0 +1,336 @@
+#ifndef PIKO_INSTRUMENT_H
+#define PIKO_INSTRUMENT_H
+
+// Per-kernel statistics of pipelines built with pikoc --instrument.
+// Every kernel launch of the generated run functions adds one record to a
+// ring buffer that is allocated once, when the pipeline is allocated, and is
+// read through the getStats() member pikoc adds to the pipeline class.
+// Without --instrument neither this header nor any of its calls are emitted.
+// pikoc --perf-counters (which implies --instrument) also adds the hardware
+// counters of the host thread and of every worker thread to each record.
+
+#if defined(__PIKOC_HOST__) && !defined(__PIKOC_ANALYSIS_PHASE__)
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "piko/timer.h"
+
+#ifdef __PIKOC_PERF_COUNTERS__
+	#include "piko/perfcounters.h"
+#endif
+
+// Default number of kernel records kept; older records are overwritten
+#ifndef PIKO_STATS_CAPACITY
+	#define PIKO_STATS_CAPACITY 4096
+#endif
+
+struct PikoKernelRecord {
+	int frame;              // frames completed before this launch
+	int kernel;             // kernelN in __pikoCompiledPipe.h
+	int stage;              // index into the stage names of PikoStats
+	PikoPhase phase;
+	double startMs;         // since PikoStats::reset()
+	double timeMs;          // wall time of the launch
+	long long inputPrims;   // primitives waiting in the stage's bins (input array for AssignBin)
+	long long emittedPrims; // primitives added to the bins of the other stages
+	int activeBins;         // bins of the stage holding at least one primitive
+#ifdef __PIKOC_PERF_COUNTERS__
+	PikoCounterValues counters; // host thread and all worker threads
+#endif
+};
+
+class PikoStats {
+public:
+	PikoStats()
+		: records_(PIKO_STATS_CAPACITY)
+		, next_(0)
+		, numRecords_(0)
+		, numDropped_(0)
+		, numFrames_(0)
+		, epoch_(0.0)
+		, start_(0.0)
+	{}
+
+	// Resizing drops all records; do it before running the pipeline
+	void setCapacity(int capacity) {
+		records_.assign(capacity > 0 ? capacity : 1, PikoKernelRecord());
+		clear();
+	}
+
+	void reset() {
+		stageNames_.clear();
+		clear();
+	}
+
+#ifdef __PIKOC_PERF_COUNTERS__
+	// Opens the counters of the calling (host) thread and makes room for the
+	// counts of `numWorkers` worker threads
+	void setNumWorkers(int numWorkers) {
+		if(!host_.open())
+			printf("Hardware counters are unavailable (see /proc/sys/kernel/perf_event_paranoid)\n");
+		workers_.assign(numWorkers, WorkerCounters());
+	}
+#endif
+
+	void addStage(const char* name) {
+		stageNames_.push_back(name);
+	}
+
+	void clear() {
+		next_ = 0;
+		numRecords_ = 0;
+		numDropped_ = 0;
+		numFrames_ = 0;
+		epoch_ = pikoWallTimeMs();
+#ifdef __PIKOC_PERF_COUNTERS__
+		for(unsigned i = 0; i < workers_.size(); ++i)
+			workers_[i].total.clear();
+#endif
+	}
+
+	// ----- queries -----
+
+	int getNumStages() const { return stageNames_.size(); }
+	const char* getStageName(int stage) const { return stageNames_[stage].c_str(); }
+	int getNumFrames() const { return numFrames_; }
+	int getCapacity() const { return records_.size(); }
+
+	// Records still in the buffer, and records that were overwritten
+	int getNumRecords() const { return numRecords_; }
+	long long getNumDropped() const { return numDropped_; }
+
+	// Oldest first
+	const PikoKernelRecord& getRecord(int i) const {
+		int first = (next_ - numRecords_ + getCapacity()) % getCapacity();
+		return records_[(first + i) % getCapacity()];
+	}
+
+	// Sum of the buffered records of a stage and phase (PIKO_PHASE_COUNT for all)
+	double getStageTime(int stage, PikoPhase phase = PIKO_PHASE_COUNT) const {
+		double t = 0.0;
+		for(int i = 0; i < numRecords_; ++i) {
+			const PikoKernelRecord& r = getRecord(i);
+			if(r.stage == stage && (phase == PIKO_PHASE_COUNT || r.phase == phase))
+				t += r.timeMs;
+		}
+		return t;
+	}
+
+#ifdef __PIKOC_PERF_COUNTERS__
+	// Sum of a counter over the buffered records of a stage and phase
+	// (PIKO_PHASE_COUNT for all)
+	long long getStageCounter(int stage, PikoCounter counter, PikoPhase phase = PIKO_PHASE_COUNT) const {
+		long long n = 0;
+		for(int i = 0; i < numRecords_; ++i) {
+			const PikoKernelRecord& r = getRecord(i);
+			if(r.stage == stage && (phase == PIKO_PHASE_COUNT || r.phase == phase))
+				n += r.counters.v[counter];
+		}
+		return n;
+	}
+
+	// Counts of worker thread `t` since clear(), over all kernels
+	int getNumWorkers() const { return workers_.size(); }
+	const PikoCounterValues& getWorkerCounters(int t) const { return workers_[t].total; }
+#endif
+
+	void print() const {
+		static const char* phaseNames[PIKO_PHASE_COUNT] = { "assignBin", "schedule", "process" };
+
+		printf("%d kernel launches over %d frames (%lld dropped)\n",
+			numRecords_, numFrames_, numDropped_);
+		printf("%-24s %-10s %9s %8s %12s %12s %10s\n",
+			"stage", "phase", "msec", "launches", "input", "emitted", "bins");
+		for(int s = 0; s < getNumStages(); ++s) {
+			for(int p = 0; p < PIKO_PHASE_COUNT; ++p) {
+				double t = 0.0;
+				long long launches = 0, input = 0, emitted = 0, bins = 0;
+				for(int i = 0; i < numRecords_; ++i) {
+					const PikoKernelRecord& r = getRecord(i);
+					if(r.stage != s || r.phase != p)
+						continue;
+					t += r.timeMs;
+					launches += 1;
+					input += r.inputPrims;
+					emitted += r.emittedPrims;
+					bins += r.activeBins;
+				}
+				if(launches == 0)
+					continue;
+				printf("%-24s %-10s %9.3f %8lld %12lld %12lld %10lld\n",
+					getStageName(s), phaseNames[p], t, launches, input, emitted, bins);
+			}
+		}
+#ifdef __PIKOC_PERF_COUNTERS__
+		printCounters();
+#endif
+	}
+
+	// ----- called by the generated run functions -----
+
+	void beginKernel(int kernel, int stage, PikoPhase phase) {
+		cur_.frame = numFrames_;
+		cur_.kernel = kernel;
+		cur_.stage = stage;
+		cur_.phase = phase;
+		cur_.inputPrims = 0;
+		cur_.emittedPrims = 0;
+		cur_.activeBins = 0;
+	}
+
+	void setInput(long long prims) {
+		cur_.inputPrims = prims;
+	}
+
+	template <class StageType>
+	void countInput(StageType& stg) {
+		countInputBins(stg.getBin(0), stg.getNumBins());
+	}
+
+	// Called for every other stage around the launch: what they gained was
+	// emitted by this kernel
+	template <class StageType>
+	void countOutputBefore(StageType& stg) {
+		cur_.emittedPrims -= countPrims(stg.getBin(0), stg.getNumBins());
+	}
+
+	template <class StageType>
+	void countOutputAfter(StageType& stg) {
+		cur_.emittedPrims += countPrims(stg.getBin(0), stg.getNumBins());
+	}
+
+	void startTimer() {
+		pikoDeviceSync();
+#ifdef __PIKOC_PERF_COUNTERS__
+		for(unsigned i = 0; i < workers_.size(); ++i)
+			workers_[i].kernel.clear();
+		host_.read(hostStart_);
+#endif
+		start_ = pikoWallTimeMs();
+	}
+
+	void stopTimer() {
+		pikoDeviceSync();
+		double t = pikoWallTimeMs();
+		cur_.startMs = start_ - epoch_;
+		cur_.timeMs = t - start_;
+#ifdef __PIKOC_PERF_COUNTERS__
+		host_.read(cur_.counters);
+		cur_.counters.sub(hostStart_);
+		for(unsigned i = 0; i < workers_.size(); ++i)
+			cur_.counters.add(workers_[i].kernel);
+#endif
+	}
+
+#ifdef __PIKOC_PERF_COUNTERS__
+	// Called by worker `t` of the CPU runner when it is done with a kernel,
+	// with the group it opened when it started
+	void addWorkerCounters(int t, const PikoPerfGroup& group) {
+		PikoCounterValues v;
+		group.read(v);
+		workers_[t].kernel.add(v);
+		workers_[t].total.add(v);
+	}
+#endif
+
+	void endKernel() {
+		if(numRecords_ == getCapacity())
+			numDropped_ += 1;
+		else
+			numRecords_ += 1;
+		records_[next_] = cur_;
+		next_ = (next_ + 1) % getCapacity();
+	}
+
+	void endFrame() {
+		++numFrames_;
+	}
+
+private:
+#ifdef __PIKOC_PERF_COUNTERS__
+	// Instructions per cycle, and misses per thousand instructions
+	void printCounters() const {
+		static const char* phaseNames[PIKO_PHASE_COUNT] = { "assignBin", "schedule", "process" };
+
+		printf("%-24s %-10s %14s %14s %6s %9s %9s %9s\n", "stage", "phase", "cycles",
+			"instructions", "IPC", "L1d MPKI", "LLC MPKI", "br MPKI");
+		for(int s = 0; s < getNumStages(); ++s) {
+			for(int p = 0; p < PIKO_PHASE_COUNT; ++p) {
+				PikoCounterValues c;
+				c.clear();
+				bool launched = false;
+				for(int i = 0; i < numRecords_; ++i) {
+					const PikoKernelRecord& r = getRecord(i);
+					if(r.stage != s || r.phase != p)
+						continue;
+					c.add(r.counters);
+					launched = true;
+				}
+				if(!launched)
+					continue;
+
+				double cycles = c.v[PIKO_COUNTER_CYCLES];
+				double kinstr = c.v[PIKO_COUNTER_INSTRUCTIONS] / 1000.0;
+				printf("%-24s %-10s %14lld %14lld %6.2f %9.2f %9.2f %9.2f\n",
+					getStageName(s), phaseNames[p], c.v[PIKO_COUNTER_CYCLES],
+					c.v[PIKO_COUNTER_INSTRUCTIONS],
+					cycles > 0 ? c.v[PIKO_COUNTER_INSTRUCTIONS] / cycles : 0.0,
+					kinstr > 0 ? c.v[PIKO_COUNTER_L1D_MISSES] / kinstr : 0.0,
+					kinstr > 0 ? c.v[PIKO_COUNTER_LLC_MISSES] / kinstr : 0.0,
+					kinstr > 0 ? c.v[PIKO_COUNTER_BRANCH_MISSES] / kinstr : 0.0);
+			}
+		}
+	}
+
+	// Padded so that the counts of neighbouring workers do not share a
+	// cache line
+	struct WorkerCounters {
+		PikoCounterValues kernel;   // current kernel
+		PikoCounterValues total;    // since clear()
+		char pad[64];
+
+		WorkerCounters() {
+			kernel.clear();
+			total.clear();
+		}
+	};
+#endif
+
+	template <class BinType>
+	void countInputBins(BinType* bins, int numBins) {
+		for(int i = 0; i < numBins; ++i) {
+			int n = bins[i].getNumPrims();
+			cur_.inputPrims += n;
+			if(n > 0)
+				cur_.activeBins += 1;
+		}
+	}
+
+	template <class BinType>
+	static long long countPrims(BinType* bins, int numBins) {
+		long long n = 0;
+		for(int i = 0; i < numBins; ++i)
+			n += bins[i].getNumPrims();
+		return n;
+	}
+
+	std::vector<PikoKernelRecord> records_;
+	std::vector<std::string> stageNames_;
+	PikoKernelRecord cur_;
+	int next_;
+	int numRecords_;
+	long long numDropped_;
+	int numFrames_;
+	double epoch_;
+	double start_;
+#ifdef __PIKOC_PERF_COUNTERS__
+	PikoPerfGroup host_;
+	PikoCounterValues hostStart_;
+	std::vector<WorkerCounters> workers_;
+#endif
+};
+
+#endif // __PIKOC_HOST__ && !__PIKOC_ANALYSIS_PHASE__
+#endif // PIKO_INSTRUMENT_H
@@ -0,0 +1,294 @@
+#ifndef PIKO_MUTABLE_STATE_H
+#define PIKO_MUTABLE_STATE_H
+
+// Device buffers of the MutableState.
+//
+// A MutableState refers to its per-pixel buffers (e.g. zBuffer) by pointer,
+// so that their size follows the screen of the ConstantState instead of
+// being fixed when the pipeline is built. The host allocates the buffers of
+// its MutableState with pikoAllocateMutableState(). The allocate() of a
+// pipeline gives its device copy buffers of the same size (PikoDeviceState),
+// and prepare() copies the state and these buffers only, so the cost of a
+// frame scales with the resolution. Changing the resolution takes a new
+// allocate() with the new ConstantState, not a new pipeline build.
+//
+// A state type describes its buffers with these overloads, which the
+// runtime and captures (piko/capture.h) use:
+//   int    pikoNumDeviceBuffers(const State&)
+//   size_t pikoDeviceBufferBytes(const State&, int i, int w, int h)
+//   void*  pikoGetDeviceBuffer(const State&, int i)
+//   void   pikoSetDeviceBuffer(State&, int i, void* data)
+//   bool   pikoDeviceBufferFromHost(const State&, int i)
+//   bool   pikoDeviceBufferStatic(const State&, int i)
+// where w x h is the screen size; a buffer may also be sized by the fields
+// of the state, like MutableState::vertexBuffer. They are defined below for
+// MutableState, whose buffers are indexed by PikoMutableStateBuffer and
+// flagged in pikoMutableStateBufferFlags().
+// Buffers that are not from the host are filled by the pipeline itself: the
+// host does not allocate them, and prepare() and captures do not copy them.
+// Static buffers are not from the host either, but the host fills them and
+// owns their memory, and allocate() copies them once rather than prepare()
+// every frame, like MutableState::geometryBuffer.
+
+#include "builtinTypes.h"
+#include "screen.h"
+
+#if defined(__PIKOC_HOST__) && !defined(__PIKOC_ANALYSIS_PHASE__)
+
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#if defined(__PIKOC_PTX__)
+	#include "internal/cudaMacros.h"
+	#include <cuda.h>
+#endif
+
+// The buffers of MutableState
+enum PikoMutableStateBuffer {
+	PIKO_BUF_Z,
+	PIKO_BUF_HIZ,
+	PIKO_BUF_VIS,
+	PIKO_BUF_VERTEX,
+	PIKO_BUF_GEOMETRY,
+	PIKO_NUM_BUFS
+};
+
+// How the host and the device copy of a state treat a buffer
+enum PikoDeviceBufferFlags {
+	PIKO_BUF_FROM_HOST = 1 << 0,
+	PIKO_BUF_STATIC    = 1 << 1,
+};
+
+inline int pikoMutableStateBufferFlags(int i) {
+	static const int flags[PIKO_NUM_BUFS] = {
+		PIKO_BUF_FROM_HOST,   // PIKO_BUF_Z
+		PIKO_BUF_FROM_HOST,   // PIKO_BUF_HIZ
+		PIKO_BUF_FROM_HOST,   // PIKO_BUF_VIS
+		0,                    // PIKO_BUF_VERTEX
+		PIKO_BUF_STATIC,      // PIKO_BUF_GEOMETRY
+	};
+	return flags[i];
+}
+
+inline int pikoNumDeviceBuffers(const MutableState& state) {
+	return PIKO_NUM_BUFS;
+}
+
+inline size_t pikoDeviceBufferBytes(const MutableState& state, int i, int w, int h) {
+	switch(i) {
+	case PIKO_BUF_Z:
+		return pikoPixelBufferSize(w, h) * sizeof(float);
+	case PIKO_BUF_HIZ: {
+		int tilesX = (w + PIKO_HIZ_TILE - 1) >> PIKO_HIZ_TILE_LG2;
+		int tilesY = (h + PIKO_HIZ_TILE - 1) >> PIKO_HIZ_TILE_LG2;
+		return tilesX * tilesY * sizeof(int);
+	}
+	case PIKO_BUF_VIS:
+		return pikoPixelBufferSize(w, h) * sizeof(int);
+	case PIKO_BUF_VERTEX:
+		return (size_t) state.numVertices * state.vertexBytes;
+	default:
+		return state.geometryBytes;
+	}
+}
+
+inline void* pikoGetDeviceBuffer(const MutableState& state, int i) {
+	switch(i) {
+	case PIKO_BUF_Z:      return (void*) state.zBuffer;
+	case PIKO_BUF_HIZ:    return (void*) state.hizBuffer;
+	case PIKO_BUF_VIS:    return (void*) state.visBuffer;
+	case PIKO_BUF_VERTEX: return state.vertexBuffer;
+	default:              return state.geometryBuffer;
+	}
+}
+
+inline void pikoSetDeviceBuffer(MutableState& state, int i, void* data) {
+	switch(i) {
+	case PIKO_BUF_Z:      state.zBuffer        = (float*) data; break;
+	case PIKO_BUF_HIZ:    state.hizBuffer      = (int*) data;   break;
+	case PIKO_BUF_VIS:    state.visBuffer      = (int*) data;   break;
+	case PIKO_BUF_VERTEX: state.vertexBuffer   = data;          break;
+	default:              state.geometryBuffer = data;          break;
+	}
+}
+
+inline bool pikoDeviceBufferFromHost(const MutableState& state, int i) {
+	return (pikoMutableStateBufferFlags(i) & PIKO_BUF_FROM_HOST) != 0;
+}
+
+inline bool pikoDeviceBufferStatic(const MutableState& state, int i) {
+	return (pikoMutableStateBufferFlags(i) & PIKO_BUF_STATIC) != 0;
+}
+
+// Allocates the buffers of a host state for the screen of constState. Their
+// contents are undefined. Buffers that are not from the host are left NULL,
+// and static ones as they are. So are the buffers i with bit (1 << i) set in
+// unusedBuffers, which the pipeline does not use, e.g. (1 << PIKO_BUF_VIS);
+// the device then gets no copy of them either.
+template<class State>
+void pikoAllocateMutableState(State& state, const ConstantState& constState,
+	unsigned unusedBuffers = 0)
+{
+	for(int i = 0; i < pikoNumDeviceBuffers(state); ++i) {
+		if(pikoDeviceBufferStatic(state, i))
+			continue;
+		if(!pikoDeviceBufferFromHost(state, i) || (unusedBuffers & (1u << i))) {
+			pikoSetDeviceBuffer(state, i, NULL);
+			continue;
+		}
+
+		size_t bytes = pikoDeviceBufferBytes(state, i,
+			constState.screenSizeX, constState.screenSizeY);
+		pikoSetDeviceBuffer(state, i, malloc(bytes));
+	}
+}
+
+template<class State>
+void pikoFreeMutableState(State& state) {
+	for(int i = 0; i < pikoNumDeviceBuffers(state); ++i) {
+		if(pikoDeviceBufferStatic(state, i))
+			continue;
+		::free(pikoGetDeviceBuffer(state, i));
+		pikoSetDeviceBuffer(state, i, NULL);
+	}
+}
+
+// The device copy of a pipeline's State
+template<class State>
+class PikoDeviceState
+{
+public:
+	PikoDeviceState()
+		: d_state_(0)
+	{}
+
+	// Sizes the buffers for the screen of constState and the fields of
+	// h_state, and copies its static buffers. A buffer from the host that
+	// h_state leaves NULL is not allocated. Allocating again frees the
+	// buffers of the previous allocate() first.
+	void allocate(const ConstantState& constState, const State& h_state) {
+		if(d_state_ != 0)
+			free();
+		memset(&image_, 0, sizeof(State));
+
+		#if defined(__PIKOC_PTX__)
+			CUDACHECK(cuMemAlloc(&d_state_, sizeof(State)));
+		#elif defined(__PIKOC_CPU__)
+			d_state_ = (State*) malloc(sizeof(State));
+		#else
+			This_Code_Should_Never_Get_Compiled_!
+		#endif
+
+		bytes_.resize(pikoNumDeviceBuffers(image_));
+		for(size_t i = 0; i < bytes_.size(); ++i) {
+			bytes_[i] = pikoDeviceBufferBytes(h_state, i,
+				constState.screenSizeX, constState.screenSizeY);
+			if(pikoDeviceBufferFromHost(h_state, i) && pikoGetDeviceBuffer(h_state, i) == NULL)
+				bytes_[i] = 0;
+			if(bytes_[i] == 0) {
+				pikoSetDeviceBuffer(image_, i, NULL);
+				continue;
+			}
+
+			#if defined(__PIKOC_PTX__)
+				CUdeviceptr d_buffer;
+				CUDACHECK(cuMemAlloc(&d_buffer, bytes_[i]));
+				pikoSetDeviceBuffer(image_, i, (void*) d_buffer);
+			#elif defined(__PIKOC_CPU__)
+				pikoSetDeviceBuffer(image_, i, malloc(bytes_[i]));
+			#else
+				This_Code_Should_Never_Get_Compiled_!
+			#endif
+
+			const void* h_buffer = pikoGetDeviceBuffer(h_state, i);
+			if(h_buffer == NULL || !pikoDeviceBufferStatic(h_state, i))
+				continue;
+
+			#if defined(__PIKOC_PTX__)
+				CUDACHECK(cuMemcpyHtoD(d_buffer, h_buffer, bytes_[i]));
+			#elif defined(__PIKOC_CPU__)
+				memcpy(pikoGetDeviceBuffer(image_, i), h_buffer, bytes_[i]);
+			#else
+				This_Code_Should_Never_Get_Compiled_!
+			#endif
+		}
+	}
+
+	// Copies h_state and its buffers from the host
+	void copyFrom(const State& h_state) {
+		std::vector<void*> d_buffers(bytes_.size());
+		for(size_t i = 0; i < bytes_.size(); ++i)
+			d_buffers[i] = pikoGetDeviceBuffer(image_, i);
+
+		image_ = h_state;
+		for(size_t i = 0; i < bytes_.size(); ++i) {
+			pikoSetDeviceBuffer(image_, i, d_buffers[i]);
+
+			const void* h_buffer = pikoGetDeviceBuffer(h_state, i);
+			if(h_buffer == NULL || bytes_[i] == 0 || !pikoDeviceBufferFromHost(h_state, i))
+				continue;
+
+			#if defined(__PIKOC_PTX__)
+				CUDACHECK(cuMemcpyHtoD((CUdeviceptr) d_buffers[i], h_buffer, bytes_[i]));
+			#elif defined(__PIKOC_CPU__)
+				memcpy(d_buffers[i], h_buffer, bytes_[i]);
+			#else
+				This_Code_Should_Never_Get_Compiled_!
+			#endif
+		}
+
+		#if defined(__PIKOC_PTX__)
+			CUDACHECK(cuMemcpyHtoD(d_state_, &image_, sizeof(State)));
+		#elif defined(__PIKOC_CPU__)
+			memcpy(d_state_, &image_, sizeof(State));
+		#else
+			This_Code_Should_Never_Get_Compiled_!
+		#endif
+	}
+
+	void free() {
+		for(size_t i = 0; i < bytes_.size(); ++i) {
+			if(bytes_[i] == 0)
+				continue;
+
+			#if defined(__PIKOC_PTX__)
+				CUDACHECK(cuMemFree((CUdeviceptr) pikoGetDeviceBuffer(image_, i)));
+			#elif defined(__PIKOC_CPU__)
+				::free(pikoGetDeviceBuffer(image_, i));
+			#else
+				This_Code_Should_Never_Get_Compiled_!
+			#endif
+		}
+		bytes_.clear();
+
+		#if defined(__PIKOC_PTX__)
+			CUDACHECK(cuMemFree(d_state_));
+		#elif defined(__PIKOC_CPU__)
+			::free(d_state_);
+		#else
+			This_Code_Should_Never_Get_Compiled_!
+		#endif
+		d_state_ = 0;
+	}
+
+	#if defined(__PIKOC_PTX__)
+	CUdeviceptr get() { return d_state_; }
+	#elif defined(__PIKOC_CPU__)
+	State* get() { return d_state_; }
+	#endif
+
+private:
+	// the state as the device sees it, with the device buffers
+	State image_;
+	std::vector<size_t> bytes_;
+
+	#if defined(__PIKOC_PTX__)
+	CUdeviceptr d_state_;
+	#elif defined(__PIKOC_CPU__)
+	State* d_state_;
+	#endif
+};
+
+#endif // __PIKOC_HOST__ && !__PIKOC_ANALYSIS_PHASE__
+#endif // PIKO_MUTABLE_STATE_H
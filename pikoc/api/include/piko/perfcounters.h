@@ -0,0 +1,147 @@
+#ifndef PIKO_PERFCOUNTERS_H
+#define PIKO_PERFCOUNTERS_H
+
+// Hardware performance counters of pipelines built with pikoc
+// --perf-counters (CPU target, Linux). A PikoPerfGroup counts the events of
+// the calling thread only. The CPU runner opens one group in every worker
+// thread of a kernel and the host thread keeps one open for the whole run;
+// PikoStats adds up their counts per kernel launch.
+//
+// Counters can be unavailable: perf_event_paranoid may forbid them, a
+// virtual machine may have no PMU, and other platforms have no
+// perf_event_open. Groups then stay closed and count nothing.
+
+#if defined(__PIKOC_HOST__) && !defined(__PIKOC_ANALYSIS_PHASE__)
+
+#include <cstdio>
+#include <cstring>
+
+#ifdef __linux__
+	#include <linux/perf_event.h>
+	#include <sys/ioctl.h>
+	#include <sys/syscall.h>
+	#include <unistd.h>
+#endif
+
+enum PikoCounter {
+	PIKO_COUNTER_CYCLES = 0,
+	PIKO_COUNTER_INSTRUCTIONS,
+	PIKO_COUNTER_L1D_MISSES,
+	PIKO_COUNTER_LLC_MISSES,
+	PIKO_COUNTER_BRANCH_MISSES,
+	PIKO_COUNTER_COUNT,
+};
+
+inline const char* pikoCounterName(int counter) {
+	static const char* names[PIKO_COUNTER_COUNT] = {
+		"cycles", "instructions", "L1d misses", "LLC misses", "branch misses"
+	};
+	return names[counter];
+}
+
+struct PikoCounterValues {
+	long long v[PIKO_COUNTER_COUNT];
+
+	void clear() {
+		for(int i = 0; i < PIKO_COUNTER_COUNT; ++i)
+			v[i] = 0;
+	}
+
+	void add(const PikoCounterValues& o) {
+		for(int i = 0; i < PIKO_COUNTER_COUNT; ++i)
+			v[i] += o.v[i];
+	}
+
+	void sub(const PikoCounterValues& o) {
+		for(int i = 0; i < PIKO_COUNTER_COUNT; ++i)
+			v[i] -= o.v[i];
+	}
+};
+
+class PikoPerfGroup {
+public:
+	PikoPerfGroup() {
+		for(int i = 0; i < PIKO_COUNTER_COUNT; ++i)
+			fd_[i] = -1;
+	}
+
+	~PikoPerfGroup() { close(); }
+
+	// Opens and starts the counters of the calling thread. Events the CPU
+	// does not have are left out of the group and read as 0.
+	bool open() {
+#ifdef __linux__
+		close();
+
+		static const unsigned type[PIKO_COUNTER_COUNT] = {
+			PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE,
+			PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE
+		};
+		static const unsigned long long config[PIKO_COUNTER_COUNT] = {
+			PERF_COUNT_HW_CPU_CYCLES,
+			PERF_COUNT_HW_INSTRUCTIONS,
+			PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+				| (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+			PERF_COUNT_HW_CACHE_MISSES,
+			PERF_COUNT_HW_BRANCH_MISSES
+		};
+
+		for(int i = 0; i < PIKO_COUNTER_COUNT; ++i) {
+			struct perf_event_attr attr;
+			memset(&attr, 0, sizeof(attr));
+			attr.size = sizeof(attr);
+			attr.type = type[i];
+			attr.config = config[i];
+			attr.disabled = (fd_[0] < 0) ? 1 : 0;
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+			attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+			fd_[i] = syscall(__NR_perf_event_open, &attr, 0, -1, (fd_[0] < 0) ? -1 : fd_[0], 0);
+			if(i == 0 && fd_[0] < 0)
+				return false;
+		}
+
+		ioctl(fd_[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	bool isOpen() const { return fd_[0] >= 0; }
+
+	// Counts since open(), scaled up if the kernel multiplexed the counters
+	void read(PikoCounterValues& out) const {
+		out.clear();
+#ifdef __linux__
+		for(int i = 0; i < PIKO_COUNTER_COUNT; ++i) {
+			if(fd_[i] < 0)
+				continue;
+			unsigned long long buf[3];
+			if(::read(fd_[i], buf, sizeof(buf)) != sizeof(buf) || buf[2] == 0)
+				continue;
+			out.v[i] = (buf[2] < buf[1]) ? (long long) ((double) buf[0] * buf[1] / buf[2]) : buf[0];
+		}
+#endif
+	}
+
+	void close() {
+#ifdef __linux__
+		for(int i = PIKO_COUNTER_COUNT - 1; i >= 0; --i) {
+			if(fd_[i] >= 0)
+				::close(fd_[i]);
+			fd_[i] = -1;
+		}
+#endif
+	}
+
+private:
+	PikoPerfGroup(const PikoPerfGroup&);
+	PikoPerfGroup& operator=(const PikoPerfGroup&);
+
+	int fd_[PIKO_COUNTER_COUNT];
+};
+
+#endif // __PIKOC_HOST__ && !__PIKOC_ANALYSIS_PHASE__
+#endif // PIKO_PERFCOUNTERS_H
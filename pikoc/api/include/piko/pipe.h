@@ -5,6 +5,16 @@
 
 #include "stage.h"
 
+// pikoc --instrument adds a PikoStats member to the pipeline class
+#ifdef __PIKOC_INSTRUMENT__
+	#include "instrument.h"
+#endif
+
+// pikoc --capture adds writeCapture() to the pipeline class
+#ifdef __PIKOC_CAPTURE__
+	#include "capture.h"
+#endif
+
 template <class S1, class S2>
 static void pikoConnect(S1& outStg, S2& inStg, const int outPortNum, const int inPortNum) {
 	outStg.outPort[outPortNum] = &inStg;
@@ -0,0 +1,147 @@
+#ifndef PIKO_PROFILE_H
+#define PIKO_PROFILE_H
+
+// Host-side recorder used by pipelines built with pikoc --profile-gen.
+// The generated run functions record the bin occupancy of every stage
+// before it is scheduled, and the wall time of every kernel, then write a
+// profile that pikoc reads back with --profile=<file>.
+
+#if defined(__PIKOC_HOST__) && !defined(__PIKOC_ANALYSIS_PHASE__)
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "piko/timer.h"
+
+// Bucket 0 counts empty bins, bucket b > 0 counts bins holding
+// [2^(b-1), 2^b) primitives. The last bucket is open ended.
+#define PIKO_PROFILE_HIST_BUCKETS 16
+
+struct PikoStageProfile {
+	std::string name;
+	int numBins;
+	int samples;
+	long long prims;
+	long long activeBins;
+	long long maxBinPrims;
+	double time[PIKO_PHASE_COUNT];
+	long long hist[PIKO_PROFILE_HIST_BUCKETS];
+};
+
+class PikoProfileRecorder {
+public:
+	PikoProfileRecorder()
+		: numFrames_(0)
+		, minKernelTime_(-1.0)
+		, start_(0.0)
+	{}
+
+	void reset() {
+		stages_.clear();
+		numFrames_ = 0;
+		minKernelTime_ = -1.0;
+	}
+
+	void addStage(const char* name) {
+		PikoStageProfile s;
+		s.name = name;
+		s.numBins = 0;
+		s.samples = 0;
+		s.prims = 0;
+		s.activeBins = 0;
+		s.maxBinPrims = 0;
+		for(int i = 0; i < PIKO_PHASE_COUNT; ++i)
+			s.time[i] = 0.0;
+		for(int i = 0; i < PIKO_PROFILE_HIST_BUCKETS; ++i)
+			s.hist[i] = 0;
+		stages_.push_back(s);
+	}
+
+	template <class StageType>
+	void recordBins(int stage, StageType& stg) {
+		recordBinArray(stage, stg.getBin(0), stg.getNumBins());
+	}
+
+	void startTimer() {
+		pikoDeviceSync();
+		start_ = pikoWallTimeMs();
+	}
+
+	void stopTimer(int stage, PikoPhase phase) {
+		pikoDeviceSync();
+		double t = pikoWallTimeMs() - start_;
+		stages_[stage].time[phase] += t;
+		if(minKernelTime_ < 0.0 || t < minKernelTime_)
+			minKernelTime_ = t;
+	}
+
+	void endFrame() {
+		++numFrames_;
+	}
+
+	bool write(const char* filename, const char* pipeName) {
+		FILE* f = fopen(filename, "w");
+		if(!f) {
+			printf("Unable to write profile %s\n", filename);
+			return false;
+		}
+
+		fprintf(f, "pikoprofile 1\n");
+		fprintf(f, "pipe %s\n", pipeName);
+		fprintf(f, "frames %d\n", numFrames_);
+		fprintf(f, "launch_ms %f\n", minKernelTime_ < 0.0 ? 0.0 : minKernelTime_);
+
+		for(unsigned i = 0; i < stages_.size(); ++i) {
+			const PikoStageProfile& s = stages_[i];
+			fprintf(f, "stage %s bins %d samples %d prims %lld active %lld max %lld"
+				" assign_ms %f schedule_ms %f process_ms %f\n",
+				s.name.c_str(), s.numBins, s.samples, s.prims, s.activeBins, s.maxBinPrims,
+				s.time[PIKO_PHASE_ASSIGNBIN], s.time[PIKO_PHASE_SCHEDULE],
+				s.time[PIKO_PHASE_PROCESS]);
+
+			fprintf(f, "hist %s", s.name.c_str());
+			for(int b = 0; b < PIKO_PROFILE_HIST_BUCKETS; ++b)
+				fprintf(f, " %lld", s.hist[b]);
+			fprintf(f, "\n");
+		}
+
+		fclose(f);
+		printf("Wrote pipeline profile to %s\n", filename);
+		return true;
+	}
+
+private:
+	template <class BinType>
+	void recordBinArray(int stage, BinType* bins, int numBins) {
+		PikoStageProfile& s = stages_[stage];
+		s.numBins = numBins;
+		s.samples += 1;
+
+		long long maxPrims = 0;
+		for(int i = 0; i < numBins; ++i) {
+			long long n = bins[i].getNumPrims();
+			s.prims += n;
+			if(n > 0)
+				s.activeBins += 1;
+			if(n > maxPrims)
+				maxPrims = n;
+
+			int b = 0;
+			while(n > 0 && b < PIKO_PROFILE_HIST_BUCKETS - 1) {
+				n >>= 1;
+				++b;
+			}
+			s.hist[b] += 1;
+		}
+		s.maxBinPrims += maxPrims;
+	}
+
+	std::vector<PikoStageProfile> stages_;
+	int numFrames_;
+	double minKernelTime_;
+	double start_;
+};
+
+#endif // __PIKOC_HOST__ && !__PIKOC_ANALYSIS_PHASE__
+#endif // PIKO_PROFILE_H
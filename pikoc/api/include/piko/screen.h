@@ -0,0 +1,68 @@
+#ifndef PIKO_SCREEN_H
+#define PIKO_SCREEN_H
+
+// Layout of the per-pixel buffers: the pixels of PikoScreen and the
+// per-pixel arrays of MutableState (e.g. zBuffer).
+//
+// By default pixels are stored row by row. With PIKO_TILED_SCREEN defined
+// (e.g. pikoc -DPIKO_TILED_SCREEN) they are stored in tiles of
+// PIKO_SCREEN_TILE x PIKO_SCREEN_TILE pixels, row by row within a tile and
+// tiles row by row, so that the pixels of an 8x8 bin are contiguous instead
+// of spread over 8 rows of the screen. PikoScreen::getData() returns the
+// pixels row by row in both layouts; use pikoLinearizePixels() to read back
+// other buffers.
+//
+// Stages index these buffers with pixelIndex(x, y) (see piko/stage.h).
+
+#include "__pikoDefines.h"
+
+#define PIKO_SCREEN_TILE_LG2 3
+#define PIKO_SCREEN_TILE (1 << PIKO_SCREEN_TILE_LG2)
+
+// Index of pixel (x, y) in a per-pixel buffer of a screen w pixels wide
+inline int pikoPixelIndex(int x, int y, int w) {
+#ifdef PIKO_TILED_SCREEN
+	int tilesX = (w + PIKO_SCREEN_TILE - 1) >> PIKO_SCREEN_TILE_LG2;
+	int tile = (y >> PIKO_SCREEN_TILE_LG2) * tilesX + (x >> PIKO_SCREEN_TILE_LG2);
+	return (tile << (2 * PIKO_SCREEN_TILE_LG2))
+		+ ((y & (PIKO_SCREEN_TILE - 1)) << PIKO_SCREEN_TILE_LG2)
+		+ (x & (PIKO_SCREEN_TILE - 1));
+#else
+	return y * w + x;
+#endif
+}
+
+// Distance between pixels (x, y) and (x, y+1) of the same tile in a buffer
+// of a screen w pixels wide
+inline int pikoPixelRowPitch(int w) {
+#ifdef PIKO_TILED_SCREEN
+	return PIKO_SCREEN_TILE;
+#else
+	return w;
+#endif
+}
+
+// Number of elements of a per-pixel buffer of a w x h screen. Tiled buffers
+// are padded to whole tiles.
+inline int pikoPixelBufferSize(int w, int h) {
+#ifdef PIKO_TILED_SCREEN
+	int tilesX = (w + PIKO_SCREEN_TILE - 1) >> PIKO_SCREEN_TILE_LG2;
+	int tilesY = (h + PIKO_SCREEN_TILE - 1) >> PIKO_SCREEN_TILE_LG2;
+	return (tilesX * tilesY) << (2 * PIKO_SCREEN_TILE_LG2);
+#else
+	return w * h;
+#endif
+}
+
+#if defined(__PIKOC_HOST__) && !defined(__PIKOC_ANALYSIS_PHASE__)
+
+// Copies the w x h pixels of the per-pixel buffer src into dst row by row
+template<class T>
+void pikoLinearizePixels(const T* src, T* dst, int w, int h) {
+	for(int y = 0; y < h; ++y)
+		for(int x = 0; x < w; ++x)
+			dst[y * w + x] = src[pikoPixelIndex(x, y, w)];
+}
+
+#endif // __PIKOC_HOST__ && !__PIKOC_ANALYSIS_PHASE__
+#endif // PIKO_SCREEN_H
@@ -3,13 +3,22 @@
 
 #include "__pikoDefines.h"
 
+// 1 when each bin of the stage is processed by one thread at a time, so that
+// memory only the process() of that bin touches (e.g. the pixels of a screen
+// space bin) needs no atomics; 0 during analysis. pikoc defines it in
+// __pikoDefines.h. Use in #if, e.g. '#if PIKO_EXCLUSIVE_BINS(RasterStage)'
+#define PIKO_EXCLUSIVE_BINS(stage) __PIKO_EXCLUSIVE_BINS_##stage##__
+
 #include "builtinTypes.h"
 #include "deviceFunctions.h"
+#include "screen.h"
+#include "mutableState.h"
 
 #include "internal/datatypes.h"
 
 #ifdef __PIKOC_HOST__
 	#include <cstdlib>
+	#include <cstring>
 	#include <map>
 #ifdef __PIKOC_PTX__
 	#include <cuda.h>
@@ -19,10 +28,25 @@
 #define NUM_PORTS 5
 
 
-#ifdef __PIKOC_DEVICE__
+#if defined(__PIKOC_DEVICE_EXTERN__)
+	extern ConstantState constState;
+#elif defined(__PIKOC_DEVICE__)
 	__constant__ ConstantState constState;
 #endif
 
+#ifdef __PIKOC_DEVICE__
+// Index of pixel (x, y) of the screen in PikoScreen and in the per-pixel
+// buffers of MutableState, in the layout of piko/screen.h
+inline int pixelIndex(int x, int y) {
+	return pikoPixelIndex(x, y, constState.screenSizeX);
+}
+
+// Distance between pixels (x, y) and (x, y+1) of the same screen tile
+inline int pixelRowPitch() {
+	return pikoPixelRowPitch(constState.screenSizeX);
+}
+#endif // __PIKOC_DEVICE__
+
 class StageFloor {};
 
 template<class InPrimType>
@@ -56,7 +80,7 @@ public:
 #ifdef __PIKOC_DEVICE__
 	inline void assignBin(Pixel p)
   {
-		int i = (p.pos.y * screenSizeX_) + (p.pos.x);
+		int i = pikoPixelIndex(p.pos.x, p.pos.y, screenSizeX_);
 		d_data_[i] = p.color;
 	}
 	inline void schedule(int binID) {}
@@ -70,22 +94,31 @@ public:
 		screenSizeX_ = constStateArg->screenSizeX;
 		screenSizeY_ = constStateArg->screenSizeY;
 		numPixels_ = screenSizeX_ * screenSizeY_;
+		bufferSize_ = pikoPixelBufferSize(screenSizeX_, screenSizeY_);
 		h_data_ = (unsigned*) malloc(numPixels_*sizeof(unsigned));
 
+		// the pixels in the layout of the device, which getData() reorders
+		// into h_data_ when the screen is tiled
+		#ifdef PIKO_TILED_SCREEN
+			h_tiled_ = (unsigned*) malloc(bufferSize_*sizeof(unsigned));
+		#else
+			h_tiled_ = h_data_;
+		#endif
+
 		#if defined(__PIKOC_PTX__)
-			CUDACHECK(cuMemAlloc(&d_data_, numPixels_*sizeof(unsigned)));
+			CUDACHECK(cuMemAlloc(&d_data_, bufferSize_*sizeof(unsigned)));
 		#elif defined(__PIKOC_CPU__)
-			d_data_ = h_data_;
+			d_data_ = h_tiled_;
 		#else
 			This_Code_Should_Never_Get_Compiled_!
 		#endif
 
-		for(int i = 0; i < numPixels_; ++i) {
-			h_data_[i] = 0xff663313;
+		for(int i = 0; i < bufferSize_; ++i) {
+			h_tiled_[i] = 0xff663313;
 		}
 
 		#if defined(__PIKOC_PTX__)
-			CUDACHECK(cuMemcpyHtoD(d_data_, h_data_, numPixels_*sizeof(unsigned)));
+			CUDACHECK(cuMemcpyHtoD(d_data_, h_tiled_, bufferSize_*sizeof(unsigned)));
 		#elif defined(__PIKOC_CPU__)
 		#else
 			This_Code_Should_Never_Get_Compiled_!
@@ -99,30 +132,47 @@ public:
 		#else
 			This_Code_Should_Never_Get_Compiled_!
 		#endif
+
+		#ifdef PIKO_TILED_SCREEN
+			::free(h_tiled_);
+		#endif
 	}
 
 	int getNumPixels() {
 		return numPixels_;
 	}
 
+	// The pixels of the current frame row by row, bottom row first
 	unsigned* getData() {
 		#if defined(__PIKOC_PTX__)
-			CUDACHECK(cuMemcpyDtoH(h_data_, d_data_, numPixels_*sizeof(unsigned)));
+			CUDACHECK(cuMemcpyDtoH(h_tiled_, d_data_, bufferSize_*sizeof(unsigned)));
 		#elif defined(__PIKOC_CPU__)
 		#else
 			This_Code_Should_Never_Get_Compiled_!
 		#endif
 
+		#ifdef PIKO_TILED_SCREEN
+			pikoLinearizePixels(h_tiled_, h_data_, screenSizeX_, screenSizeY_);
+		#endif
+
 		return h_data_;
 	}
+
+	// Copies the current frame into dst, which holds getNumPixels() pixels,
+	// bottom row first like glDrawPixels
+	void readPixels(unsigned* dst) {
+		memcpy(dst, getData(), numPixels_*sizeof(unsigned));
+	}
 #endif // __PIKOC_HOST__
 #endif //ndef __PIKOC_ANALYSIS_PHASE__
 
 private:
 	int numPixels_;
+	int bufferSize_;
 	int screenSizeX_;
 	int screenSizeY_;
 	unsigned* h_data_;
+	unsigned* h_tiled_;
 #ifdef __PIKOC_DEVICE__
 	unsigned* d_data_;
 #else
@@ -0,0 +1,42 @@
+#ifndef PIKO_THREADS_H
+#define PIKO_THREADS_H
+
+// Number of worker threads the CPU runner splits parallel kernels over.
+// It defaults to the number of hardware threads, and can be set with the
+// PIKO_NUM_THREADS environment variable or with pikoSetNumCPUThreads().
+// The generated allocate() and run() read it once, so a new count takes
+// effect at the next allocate().
+
+#if defined(__PIKOC_HOST__) && !defined(__PIKOC_ANALYSIS_PHASE__)
+
+#include <cstdlib>
+#include <thread>
+
+// Used when the number of hardware threads is unknown
+#define PIKO_DEFAULT_NUM_CPU_THREADS 64
+
+inline unsigned pikoDefaultNumCPUThreads() {
+	const char* env = getenv("PIKO_NUM_THREADS");
+	if(env != NULL && atoi(env) > 0)
+		return atoi(env);
+
+	unsigned hw = std::thread::hardware_concurrency();
+	return (hw > 0) ? hw : PIKO_DEFAULT_NUM_CPU_THREADS;
+}
+
+inline unsigned& pikoNumCPUThreadsSetting() {
+	static unsigned numThreads = pikoDefaultNumCPUThreads();
+	return numThreads;
+}
+
+inline unsigned pikoGetNumCPUThreads() {
+	return pikoNumCPUThreadsSetting();
+}
+
+// 0 restores the default
+inline void pikoSetNumCPUThreads(unsigned numThreads) {
+	pikoNumCPUThreadsSetting() = (numThreads > 0) ? numThreads : pikoDefaultNumCPUThreads();
+}
+
+#endif // __PIKOC_HOST__ && !__PIKOC_ANALYSIS_PHASE__
+#endif // PIKO_THREADS_H
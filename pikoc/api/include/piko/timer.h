@@ -0,0 +1,40 @@
+#ifndef PIKO_TIMER_H
+#define PIKO_TIMER_H
+
+// Wall-clock timing for host code and the generated run functions. clock()
+// measures the CPU time of the whole process, which on the CPU target adds up
+// the time of every worker thread.
+
+#if defined(__PIKOC_HOST__) && !defined(__PIKOC_ANALYSIS_PHASE__)
+
+#include <time.h>
+
+#ifdef __PIKOC_PTX__
+	#include <cuda.h>
+#endif
+
+// The part of a stage that a kernel timer is attributed to
+enum PikoPhase {
+	PIKO_PHASE_ASSIGNBIN = 0,
+	PIKO_PHASE_SCHEDULE,
+	PIKO_PHASE_PROCESS,
+	PIKO_PHASE_COUNT,
+};
+
+// Milliseconds on a monotonic clock, unaffected by changes to the system time
+inline double pikoWallTimeMs() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+// Kernel launches are asynchronous on the GPU: wait for them before reading
+// the clock
+inline void pikoDeviceSync() {
+#ifdef __PIKOC_PTX__
+	cuCtxSynchronize();
+#endif
+}
+
+#endif // __PIKOC_HOST__ && !__PIKOC_ANALYSIS_PHASE__
+#endif // PIKO_TIMER_H
@@ -0,0 +1,192 @@
+#ifndef PIKO_TRACE_H
+#define PIKO_TRACE_H
+
+// Execution trace of pipelines built with pikoc --trace (CPU target).
+// The generated run functions record a span for every kernel launch on the
+// host thread, and the CPU runner records a span for every bin each worker
+// thread processes. The trace is written as Chrome trace-event JSON, which
+// can be opened in Perfetto (ui.perfetto.dev) or chrome://tracing.
+//
+// Every thread writes only to its own preallocated buffer, so recording
+// takes no locks; the buffers are read once the workers are joined. Only one
+// frame in getSampleRate() is recorded, so that tracing can be left on:
+// the rate is read from the PIKO_TRACE_SAMPLE environment variable (default
+// 1, every frame; 0 records nothing) and can be changed with setSampleRate().
+// The buffers are allocated before the first recorded frame, so a rate of 0
+// costs no memory.
+
+#if defined(__PIKOC_HOST__) && !defined(__PIKOC_ANALYSIS_PHASE__)
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "piko/timer.h"
+
+// Spans kept per thread; later spans of a full buffer are dropped
+#ifndef PIKO_TRACE_CAPACITY
+	#define PIKO_TRACE_CAPACITY 65536
+#endif
+
+struct PikoTraceSpan {
+	const char* name;   // string literal emitted by pikoc
+	int kernel;
+	int bin;            // -1 for kernel spans
+	int frame;
+	double startMs;
+	double durMs;
+};
+
+class PikoTraceRecorder {
+public:
+	PikoTraceRecorder()
+		: sampleRate_(1)
+		, frame_(0)
+		, sampled_(false)
+		, epoch_(0.0)
+		, kernelStart_(0.0)
+	{}
+
+	// Thread 0 is the host thread, worker t of the CPU runner is thread t+1
+	void reset(int numWorkers) {
+		const char* rate = getenv("PIKO_TRACE_SAMPLE");
+		if(rate != NULL)
+			sampleRate_ = atoi(rate);
+
+		threads_.assign(numWorkers + 1, ThreadBuffer());
+
+		frame_ = 0;
+		epoch_ = pikoWallTimeMs();
+		beginFrame();
+	}
+
+	// Record one frame in `rate`, or none if `rate` is 0
+	void setSampleRate(int rate) {
+		sampleRate_ = rate;
+		beginFrame();
+	}
+
+	int getSampleRate() const { return sampleRate_; }
+
+	bool sampled() const { return sampled_; }
+
+	double now() const { return sampled_ ? pikoWallTimeMs() : 0.0; }
+
+	// ----- called by the generated run functions -----
+
+	void beginKernel() {
+		kernelStart_ = now();
+	}
+
+	void endKernel(const char* name, int kernel) {
+		if(sampled_)
+			record(0, name, kernel, -1, kernelStart_);
+	}
+
+	// Called by worker `t` after it processed bin `bin`, with the value of
+	// now() from before
+	void endBin(int t, const char* name, int kernel, int bin, double start) {
+		if(sampled_)
+			record(t + 1, name, kernel, bin, start);
+	}
+
+	void endFrame() {
+		++frame_;
+		beginFrame();
+	}
+
+	// ----- output -----
+
+	bool write(const char* filename) const {
+		FILE* f = fopen(filename, "w");
+		if(!f) {
+			printf("Unable to write trace %s\n", filename);
+			return false;
+		}
+
+		fprintf(f, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+		bool first = true;
+		long long dropped = 0;
+		for(unsigned t = 0; t < threads_.size(); ++t) {
+			const ThreadBuffer& buf = threads_[t];
+			if(buf.count == 0 && t > 0)
+				continue;
+
+			char threadName[32];
+			if(t == 0)
+				snprintf(threadName, sizeof(threadName), "host");
+			else
+				snprintf(threadName, sizeof(threadName), "worker %u", t - 1);
+			fprintf(f, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %u,"
+				" \"args\": {\"name\": \"%s\"}}", first ? "" : ",\n", t, threadName);
+			first = false;
+
+			for(int i = 0; i < buf.count; ++i) {
+				const PikoTraceSpan& s = buf.spans[i];
+				fprintf(f, ",\n{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", \"pid\": 1,"
+					" \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f,"
+					" \"args\": {\"kernel\": %d, \"bin\": %d, \"frame\": %d}}",
+					s.name, s.bin < 0 ? "kernel" : "bin", t,
+					s.startMs * 1000.0, s.durMs * 1000.0, s.kernel, s.bin, s.frame);
+			}
+			dropped += buf.dropped;
+		}
+		fprintf(f, "\n]}\n");
+		fclose(f);
+
+		printf("Wrote trace to %s", filename);
+		if(dropped > 0)
+			printf(" (%lld spans dropped, increase PIKO_TRACE_CAPACITY)", dropped);
+		printf("\n");
+		return true;
+	}
+
+private:
+	// Padded so that the counters of neighbouring threads do not share a
+	// cache line
+	struct ThreadBuffer {
+		ThreadBuffer() : count(0), dropped(0) {}
+		std::vector<PikoTraceSpan> spans;
+		int count;
+		long long dropped;
+		char pad[64];
+	};
+
+	// Runs on the host thread between frames, while no worker records
+	void beginFrame() {
+		sampled_ = (sampleRate_ > 0) && (frame_ % sampleRate_ == 0);
+		if(!sampled_)
+			return;
+
+		for(unsigned i = 0; i < threads_.size(); ++i) {
+			if(threads_[i].spans.empty())
+				threads_[i].spans.resize(PIKO_TRACE_CAPACITY);
+		}
+	}
+
+	void record(int thread, const char* name, int kernel, int bin, double start) {
+		ThreadBuffer& buf = threads_[thread];
+		if(buf.count == (int) buf.spans.size()) {
+			buf.dropped += 1;
+			return;
+		}
+
+		PikoTraceSpan& s = buf.spans[buf.count++];
+		s.name = name;
+		s.kernel = kernel;
+		s.bin = bin;
+		s.frame = frame_;
+		s.startMs = start - epoch_;
+		s.durMs = pikoWallTimeMs() - start;
+	}
+
+	std::vector<ThreadBuffer> threads_;
+	int sampleRate_;
+	int frame_;
+	bool sampled_;
+	double epoch_;
+	double kernelStart_;
+};
+
+#endif // __PIKOC_HOST__ && !__PIKOC_ANALYSIS_PHASE__
+#endif // PIKO_TRACE_H
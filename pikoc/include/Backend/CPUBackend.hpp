@@ -10,6 +10,7 @@
 #include <vector>
 
 #include "llvm/Module.h"
+#include "llvm/Target/TargetMachine.h"
 
 class CPUBackend : public PikoBackend {
 public:
@@ -20,7 +21,7 @@ public:
 		: PikoBackend(pikocOptions, psum, kernelList)
 	{}
 
-	virtual bool createLLVMModule() override { return true; }
+	virtual bool createLLVMModule();
 	virtual bool optimizeLLVMModule(int optLevel);
 
 	virtual bool emitDefines(std::ostream& outfile);
@@ -34,11 +35,19 @@ public:
 
 protected:
 	virtual std::string getTargetTriple() { return "x86_64-pc"; }
+	virtual void addClangArgs(std::vector<const char*>& args);
+	virtual void setTargetOptions(clang::TargetOptions& targetOptions);
 
 private:
+	// Device code is compiled into its own object at -O1 and above;
+	// otherwise the host compiler compiles it along with the host code
+	bool emitObject() { return pikocOptions.optLevel > 0; }
+	llvm::TargetMachine* createTargetMachine();
+	std::string targetCPU();
+
 	void writeKernelCalls(std::string tabs, std::ostream& outfile);
 	void writeKernelRunner(int kernelID, std::string params, std::string tabs,
-		std::ostream& outfile, bool parallel);
+		std::ostream& outfile, bool parallel, std::string traceLabel);
 };
 
 #endif // CPU_BACKEND_HPP
@@ -11,6 +11,11 @@
 
 #include "llvm/Module.h"
 
+namespace clang {
+	class CompilerInstance;
+	class TargetOptions;
+}
+
 class PikoBackend {
 public:
 	explicit PikoBackend(
@@ -20,6 +25,9 @@ public:
 		: pikocOptions(pikocOptions)
 		, psum(psum)
 		, kernelList(kernelList)
+		, kernelNames(makeKernelNames(kernelList, pikocOptions.optimize))
+		, module(NULL)
+		, compiler(NULL)
 	{}
 
 	virtual ~PikoBackend() {}
@@ -39,10 +47,51 @@ public:
 protected:
 	virtual std::string getTargetTriple() = 0;
 
+	// Additional clang arguments for parsing the device code of this target
+	virtual void addClangArgs(std::vector<const char*>& args) {}
+
+	// CPU and features the device code is parsed for, so that the frontend
+	// defines the same target macros (e.g. __AVX2__) the code is compiled with
+	virtual void setTargetOptions(clang::TargetOptions& targetOptions) {}
+
+	// Host code for the recorders of --profile-gen, --bench, --instrument,
+	// --trace and --bin-report builds, shared by all backends. Each of these writes nothing
+	// unless a recorder that uses it is enabled.
+	bool profiling() { return pikocOptions.profileGenFile != ""; }
+	bool benchmarking() { return pikocOptions.bench; }
+	bool instrumenting() { return pikocOptions.instrument; }
+	bool countingEvents() { return pikocOptions.perfCounters; }
+	bool tracing() { return pikocOptions.traceFile != ""; }
+	bool reportingBins() { return pikocOptions.binReportFile != ""; }
+	std::string traceLabel(stageSummary* stg, std::string phase);
+	int stageIndex(stageSummary* stg);
+	void writeRecorderDecl(std::ostream& outfile);
+	void writeRecorderMembers(std::ostream& outfile);
+	void writeRecorderSetup(std::string tabs, std::ostream& outfile);
+	void writeRecorderBins(stageSummary* stg, std::string tabs, std::ostream& outfile);
+	void writeRecorderTimerStart(int kernel, stageSummary* stg, std::string phase,
+		std::string tabs, std::ostream& outfile);
+	void writeRecorderTimerStop(int kernel, stageSummary* stg, std::string phase,
+		std::string tabs, std::ostream& outfile);
+	void writeRecorderOutputCount(stageSummary* stg, std::string phase,
+		std::string when, std::string tabs, std::ostream& outfile);
+	void writeRecorderFrameEnd(std::string tabs, std::ostream& outfile);
+	void writeRecorderOutput(std::string tabs, std::ostream& outfile);
+
+	// writeCapture() of --capture builds, a line of __PIKO_DEVICE_MEMBERS__
+	void writeCaptureMembers(std::ostream& outfile);
+
+	// The functions of module that define the emit, assignBin and process
+	// methods of the stages of psum, and the emit specializations generated
+	// for them, found by their declarations in the parsed device code
+	std::vector<llvm::Function*> stageFunctions();
+
 	const PikocOptions& pikocOptions;
 	PipeSummary& psum;
 	std::vector< std::vector<stageSummary*> >& kernelList;
+	std::vector<std::string> kernelNames;   // symbol of each kernel, by number
 	llvm::Module* module;
+	clang::CompilerInstance* compiler;   // that parsed module, kept for its AST
 };
 
 #endif // PIKO_BACKEND_HPP
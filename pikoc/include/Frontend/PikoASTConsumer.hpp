@@ -13,19 +13,18 @@ public:
 	explicit PikoASTConsumer(
 			const clang::CompilerInstance &ci
 		, PipeSummary *p
-		, std::map<std::string, stageSummary>* stageMap
-		, int passNum)
+		, std::map<std::string, stageSummary>* stageMap)
 		: stageVisitor_(ci, stageMap)
 		, pipeVisitor_(ci, p, stageMap)
-		, passNum_(passNum)
 	{}
 
-	virtual bool HandleTopLevelDecl(clang::DeclGroupRef dr);
+	// Both visitors run over the same AST: stages first, so that the pipe
+	// visitor can resolve its stage members against a complete stageMap
+	virtual void HandleTranslationUnit(clang::ASTContext &ctx);
 
 private:
 	StageASTVisitor stageVisitor_;
 	PipeASTVisitor pipeVisitor_;
-	int passNum_;
 };
 
 #endif //PIKO_AST_CONSUMER_HPP
@@ -0,0 +1,53 @@
+#ifndef PIKO_CACHE_HPP
+#define PIKO_CACHE_HPP
+
+#include "PikocOptions.hpp"
+
+#include <set>
+#include <string>
+#include <vector>
+
+// Content-addressed cache of pikoc outputs. The key covers the
+// preprocessed input, the files it includes, the options that affect code
+// generation and the pikoc build itself, so a hit can reuse the outputs of
+// an earlier run.
+class PikoCache {
+public:
+	explicit PikoCache(const PikocOptions& options);
+
+	// Preprocesses the input and computes the cache key. Returns false if
+	// the input could not be preprocessed, in which case the cache is not used
+	bool computeKey();
+
+	// Copies cached outputs into the working directory
+	bool fetch();
+
+	// Copies the outputs of this run from the working directory into the cache
+	bool store();
+
+	void recordHit()  { updateStats(1, 0); }
+	void recordMiss() { updateStats(0, 1); }
+	void printStats();
+
+	const std::string& getKey() const { return key; }
+
+private:
+	const PikocOptions& pikocOptions;
+	std::string key;
+	std::string cacheDir;
+
+	// Appends the input, preprocessed as the analysis or the device phase
+	// sees it, to text, and the files it includes to files
+	bool preprocessInput(bool analysisPhase, std::string& text,
+		std::set<std::string>& files);
+	std::string optionString();
+	std::vector<std::string> outputFiles();
+	std::string entryDir() { return cacheDir + "/" + key; }
+
+	void updateStats(int hits, int misses);
+	void readStats(long& hits, long& misses);
+
+	int lastHits, lastMisses;
+};
+
+#endif // PIKO_CACHE_HPP
@@ -0,0 +1,78 @@
+#ifndef PIKO_PROFILE_HPP
+#define PIKO_PROFILE_HPP
+
+#include "PikoSummary.hpp"
+
+#include <map>
+#include <string>
+#include <vector>
+
+// Runtime statistics of one stage, as recorded by a --profile-gen build.
+// All values are per recorded frame.
+class stageProfile{
+public:
+  std::string   name;
+  int           numBins;
+  double        samples;      // times the bins were sampled (loops sample more than once)
+  double        prims;        // primitives binned into the stage
+  double        activeBins;   // bins holding at least one primitive, summed over samples
+  double        maxBinPrims;  // occupancy of the fullest bin, summed over samples
+  double        assignMs;
+  double        scheduleMs;
+  double        processMs;
+  std::vector<long long> hist;
+
+  stageProfile(){
+    numBins     = 0;
+    samples     = 0;
+    prims       = 0;
+    activeBins  = 0;
+    maxBinPrims = 0;
+    assignMs    = 0;
+    scheduleMs  = 0;
+    processMs   = 0;
+  }
+
+  // average primitives per non-empty bin
+  double meanBinPrims() const;
+
+  // fullest bin relative to the average non-empty bin; 1 is perfectly balanced
+  double imbalance() const;
+
+  // fraction of bins that received any primitives
+  double activeFraction() const;
+};
+
+class PikoProfile{
+public:
+  std::string   filename;
+  std::string   pipeName;
+  int           frames;
+  double        launchMs;     // cheapest kernel launch observed, used as launch overhead
+
+  PikoProfile(){
+    frames   = 0;
+    launchMs = 0;
+  }
+
+  // Reads a profile written by a --profile-gen build. Returns false and
+  // prints the reason if the file cannot be used.
+  bool load(const std::string& file);
+
+  const stageProfile* findStage(const std::string& stageName) const;
+
+  // Cost model for fusing s2 into the process kernel of s1. A fused s2 runs
+  // with the bin distribution of s1, so its measured time is scaled by the
+  // ratio of the two imbalances. Keeping s2 separate costs its own launches.
+  bool shouldFuse(const stageSummary& s1, const stageSummary& s2) const;
+
+  // Prints bin size suggestions for stages whose measured occupancy is far
+  // from balanced. Bin sizes are Stage template arguments in user code, so
+  // pikoc only reports them.
+  void printBinSizeAdvice(const std::vector<stageSummary>& stages) const;
+
+private:
+  std::map<std::string, stageProfile> stages;
+};
+
+#endif //PIKO_PROFILE_HPP
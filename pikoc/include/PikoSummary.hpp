@@ -163,10 +163,12 @@ inline std::string toString(const eProcPolicy p){
 // --------------------
 
 class stageSummary;
+class PikoProfile;
 
 class assignBinSummary{
 public:
   std::string  	           codeFile;
+  int                  codeLine;
   std::string  	           sourceCode;
   eAssignPolicy        policy;
   int                  kernelID;
@@ -176,6 +178,7 @@ public:
 
   assignBinSummary(){
     codeFile          = "noAssignFile";
+    codeLine          = 0;
 		sourceCode				= "";
     policy            = assignCustom;
     kernelID  = -1;
@@ -189,6 +192,7 @@ public:
 class scheduleSummary{
 public:
   std::string                  codeFile;
+  int                     codeLine;
   std::string									sourceCode;
   eArchs                  arch;
   eSchedPolicy            schedPolicy;
@@ -202,9 +206,11 @@ public:
 	int											bucketLoopID;
   bool                    isPreScheduleCandidate;
 	bool										trivial;
+	bool										exclusiveBinsDeclared;
 
   scheduleSummary(){
     codeFile                = "noSchedFile";
+    codeLine                = 0;
 		sourceCode							= "";
     arch                    = archGPU;
     schedPolicy             = schedCustom;
@@ -218,12 +224,14 @@ public:
     endStageName            = "";
     endStagePtr             = NULL;
 		trivial										= false;
+		exclusiveBinsDeclared			= false;
   }
 };
 
 class processSummary{
 public:
   std::string                  codeFile;
+  int                     codeLine;
   std::string									sourceCode;
   int                     maxOutPrims;
   int                     kernelID;
@@ -234,6 +242,7 @@ public:
 
   processSummary(){
     codeFile    = "noProcessFile";
+    codeLine    = 0;
 		sourceCode	= "";
     maxOutPrims = 1;
     kernelID  = -1;
@@ -263,6 +272,7 @@ public:
   std::vector<scheduleSummary> schedules;
   processSummary          process;
   bool                    fusedWithNext;
+	bool                    exclusiveBins; // each bin processed by one thread at a time
 	bool                    loopStart;
 	bool                    loopEnd;
   int                     outPortTypes[5];
@@ -285,6 +295,7 @@ public:
 			nextStagesByPort.push_back(tmp);
 		}
 		fusedWithNext = false;
+		exclusiveBins = false;
 		loopStart = false;
 		loopEnd = false;
 
@@ -339,11 +350,15 @@ public:
 	bool								 preferDepthFirst;
 	bool								hasLoop;
 
+  // runtime statistics from --profile, NULL if planning statically
+  const PikoProfile*  profile;
+
   PipeSummary(){
     name              = "nopipe";
     filename          = "unknown.piko";
 		preferDepthFirst  = true;
 		hasLoop						= false;
+    profile           = NULL;
   }
 
   stageSummary* findStageByName(const std::string& stageName);
@@ -354,7 +369,16 @@ public:
   void processLinks();
 
   void generateKernelPlan(std::ostream& outfile);
+
+  // Sets exclusiveBins of every stage for the target arch
+  void findExclusiveBins(eArchs arch);
 };
 
 
+// Symbols of the kernels in __pikoCompiledPipe.h in the order they are
+// numbered, e.g. "kernel3_RasterStage_process". A kernel of fused stages is
+// named after the first of them.
+std::vector<std::string> makeKernelNames(
+	std::vector< std::vector<stageSummary*> >& kernelList, bool optimize);
+
 #endif //PIKO_SUMMARY_HPP
@@ -15,6 +15,15 @@ public:
 	bool edit;
 	bool inlineDevice;
 	bool displayGrid;
+	bool useCache;
+	bool cacheStats;
+	bool headless;
+	bool bench;
+	bool instrument;
+	bool binHeatmap;
+	bool perfCounters;
+	bool debugInfo;
+	bool capture;
 
 	std::string osString;
 
@@ -23,10 +32,19 @@ public:
 	std::string cudaIncludeDir;
 	std::string pikoIncludeDir;
 	std::string inFileName;
+	std::string cacheDir;
+	std::string cpuName;
+	std::string cpuFeatures;
+	std::string profileFile;
+	std::string profileGenFile;
+	std::string traceFile;
+	std::string binReportFile;
 
 	int numRuns;
+	int optLevel;
 
 	std::vector<std::string> includeDirs;
+	std::vector<std::string> defines;
 
 	PikocOptions() {
 		target = pikoc::PTX;
@@ -36,8 +54,18 @@ public:
 		edit = false;
 		inlineDevice = false;
 		displayGrid = false;
+		useCache = true;
+		cacheStats = false;
+		headless = false;
+		bench = false;
+		instrument = false;
+		binHeatmap = false;
+		perfCounters = false;
+		debugInfo = false;
+		capture = false;
 
 		numRuns = 1;
+		optLevel = 0;
 	}
 
 	static void printOptions();
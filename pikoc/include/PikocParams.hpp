@@ -1,10 +1,11 @@
 #ifndef PIKOC_PARAMS_HPP
 #define PIKOC_PARAMS_HPP
 
+#define PIKOC_VERSION "1.0"
+
 #define GPU_STACK_SIZE 4096
 #define LIB_DEVICE_PATH "/../nvvm/libdevice/libdevice.compute_20.10.bc"
 
-#define NUM_CLANG_PASSES 2
 #define NUM_PORTS 5
 
 #endif //PIKOC_PARAMS_HPP
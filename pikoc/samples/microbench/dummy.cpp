@@ -0,0 +1,14 @@
+/*
+this is just here so that pikoc will read this file instaed of main.
+it makes things a lot simpler
+*/
+
+#include "__pikoDefines.h"
+
+#include "microPipe.h"
+#include "__pikoCompiledPipe.h"
+
+int main()
+{
+	return 0;
+}
@@ -0,0 +1,533 @@
+// Microbenchmarks of the Piko runtime primitives on the CPU target: bin
+// insertion and fetching, the piko:: atomics in the access patterns of the
+// raster z-test, the generated emit dispatch, PikoScreen pixel writes and the
+// kernel launch overhead of the CPU runner. Every benchmark is run on 1 to N
+// threads and its time per operation is written to a JSON file, so that
+// changes to datatypes.h, atomics.h and the CPU backend can be compared
+// run to run. See README.
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "microPipe.h"
+#include "__pikoCompiledPipe.h"
+
+#ifdef __PIKOC_HOST__
+
+#include "piko/bench.h"
+
+using namespace std;
+
+#define SCREEN_W 1024
+#define SCREEN_H 768
+
+// 64 ints: the 8x8 tile of depths a raster bin tests against
+#define TILE_PIXELS 64
+
+struct MicroResult
+{
+  string name;
+  int threads;
+  long long ops;            // operations per sample, over all threads
+  PikoBenchSummary ns;      // nanoseconds per operation
+  long long lost;           // most updates lost to races in a sample, -1 if not checked
+};
+
+// Bin with access to its counters, so that its storage can be reused by every
+// sample instead of being allocated again
+class MicroBin : public Bin<micro_prim>
+{
+public:
+  MicroBin(int maxPrims) : Bin<micro_prim>(maxPrims) {}
+
+  void reset()
+  {
+    this->head_ = 0;
+    this->tail_ = 0;
+    this->numPrims_ = 0;
+  }
+
+  // Marks the first n primitives as inserted, for the fetch benchmarks
+  void fill(int n)
+  {
+    reset();
+    this->tail_ = n;
+    this->numPrims_ = n;
+  }
+};
+
+// Keeps per-thread counters on separate cache lines
+struct PaddedInt
+{
+  int v;
+  char pad[60];
+};
+
+MicroPipe piko_pipe;
+
+vector<MicroResult> results;
+int numReps = 20;
+long long opsPerThread = 1 << 16;
+string filter;
+
+unsigned nextRandom(unsigned& seed)
+{
+  seed = seed * 1664525u + 1013904223u;
+  return seed >> 8;
+}
+
+bool selected(const string& name)
+{
+  return filter == "" || name.compare(0, filter.size(), filter) == 0;
+}
+
+// Runs body(t) on `threads` threads that are released together, and returns
+// the milliseconds from their release to the last join
+template <class Body>
+double runThreads(int threads, Body& body)
+{
+  atomic<int> ready(0);
+  atomic<bool> go(false);
+  vector<thread> pool;
+  for(int t = 0; t < threads; t++)
+  {
+    pool.push_back(thread([&, t]()
+    {
+      ready++;
+      while(!go.load())
+        this_thread::yield();
+      body(t);
+    }));
+  }
+  while(ready.load() < threads)
+    this_thread::yield();
+
+  double start = pikoWallTimeMs();
+  go = true;
+  for(auto& th : pool)
+    th.join();
+  return pikoWallTimeMs() - start;
+}
+
+void addResult(const string& name, int threads, long long ops, vector<double>& samples, long long lost)
+{
+  MicroResult r;
+  r.name = name;
+  r.threads = threads;
+  r.ops = ops;
+  r.ns = pikoSummarize(samples);
+  r.lost = lost;
+  results.push_back(r);
+
+  printf("%-28s %7d %10lld %9.2f %9.2f %9.2f", name.c_str(), threads, ops,
+      r.ns.mean, r.ns.median, r.ns.p95);
+  if(lost >= 0)
+    printf(" %9lld", lost);
+  printf("\n");
+}
+
+// setup() prepares a sample, body(t) is the work of thread t and check()
+// returns the updates the sample lost, or -1. The first sample is a warm-up.
+template <class Setup, class Body, class Check>
+void measure(const string& name, int threads, long long ops, Setup setup, Body body, Check check)
+{
+  if(!selected(name))
+    return;
+
+  vector<double> samples;
+  long long lost = -1;
+  for(int rep = 0; rep <= numReps; rep++)
+  {
+    setup();
+    double ms = runThreads(threads, body);
+    long long l = check();
+    if(rep == 0)
+      continue;
+    samples.push_back(ms * 1.0e6 / ops);
+    lost = max(lost, l);
+  }
+  addResult(name, threads, ops, samples, lost);
+}
+
+// Like measure(), for work that the calling thread does itself
+template <class Body>
+void measureSerial(const string& name, int threads, long long ops, Body body)
+{
+  if(!selected(name))
+    return;
+
+  vector<double> samples;
+  for(int rep = 0; rep <= numReps; rep++)
+  {
+    double start = pikoWallTimeMs();
+    body();
+    double ms = pikoWallTimeMs() - start;
+    if(rep > 0)
+      samples.push_back(ms * 1.0e6 / ops);
+  }
+  addResult(name, threads, ops, samples, -1);
+}
+
+micro_prim makePrim(long long i)
+{
+  micro_prim p;
+  p.x = i % SCREEN_W;
+  p.y = (i / SCREEN_W) % SCREEN_H;
+  p.color = i;
+  return p;
+}
+
+// Bin::insert, fetchPrim and fetchPrimAtomic, with all threads on one bin as
+// in a shared GPU bin, or one bin per thread as the CPU runner schedules them
+void benchBins(const vector<int>& threadCounts)
+{
+  int maxThreads = threadCounts.back();
+  long long n = opsPerThread;
+
+  MicroBin shared(maxThreads * n);
+  shared.allocate();
+  shared.reset();
+  for(long long i = 0; i < maxThreads * n; i++)
+    shared.insert(makePrim(i));
+
+  vector<MicroBin*> own;
+  for(int t = 0; t < maxThreads; t++)
+  {
+    own.push_back(new MicroBin(n));
+    own[t]->allocate();
+    own[t]->reset();
+    for(long long i = 0; i < n; i++)
+      own[t]->insert(makePrim(i));
+  }
+
+  vector<PaddedInt> sink(maxThreads);
+
+  for(int mode = 0; mode < 2; mode++)
+  {
+    bool isShared = (mode == 0);
+    string suffix = isShared ? ".shared" : ".private";
+
+    for(unsigned c = 0; c < threadCounts.size(); c++)
+    {
+      int T = threadCounts[c];
+      long long total = T * n;
+
+      auto binOf = [&](int t) -> MicroBin& { return isShared ? shared : *own[t]; };
+
+      auto resetBins = [&]()
+      {
+        for(int t = 0; t < (isShared ? 1 : T); t++)
+          binOf(t).reset();
+      };
+      auto fillBins = [&]()
+      {
+        for(int t = 0; t < (isShared ? 1 : T); t++)
+          binOf(t).fill(isShared ? total : n);
+      };
+      // primitives each bin should have seen, minus those it did
+      auto lostIn = [&](int (MicroBin::*counter)(), int expected) -> long long
+      {
+        long long lost = 0;
+        for(int t = 0; t < (isShared ? 1 : T); t++)
+          lost += llabs(expected - (binOf(t).*counter)());
+        return lost;
+      };
+      int perBin = isShared ? total : n;
+
+      measure("bin.insert" + suffix, T, total, resetBins,
+          [&](int t)
+          {
+            MicroBin& bin = binOf(t);
+            for(long long i = 0; i < n; i++)
+              bin.insert(makePrim(i));
+          },
+          [&]() { return max(lostIn(&MicroBin::getTail, perBin), lostIn(&MicroBin::getNumPrims, perBin)); });
+
+      measure("bin.fetchPrim" + suffix, T, total, fillBins,
+          [&](int t)
+          {
+            MicroBin& bin = binOf(t);
+            int sum = 0;
+            for(long long i = 0; i < n; i++)
+              sum += bin.fetchPrim().color;
+            sink[t].v = sum;
+          },
+          [&]() { return lostIn(&MicroBin::getHead, perBin); });
+
+      measure("bin.fetchPrimAtomic" + suffix, T, total, fillBins,
+          [&](int t)
+          {
+            MicroBin& bin = binOf(t);
+            int sum = 0;
+            for(long long i = 0; i < n; i++)
+              sum += bin.fetchPrimAtomic().color;
+            sink[t].v = sum;
+          },
+          [&]() { return max(lostIn(&MicroBin::getHead, perBin), lostIn(&MicroBin::getNumPrims, 0)); });
+    }
+  }
+
+  shared.free();
+  for(int t = 0; t < maxThreads; t++)
+  {
+    own[t]->free();
+    delete own[t];
+  }
+}
+
+// The z-test of the raster stage: random depths are tested with atomicMin
+// against one 8x8 tile that all threads share, or against a tile per thread.
+// atomicAdd is measured on one counter, or on a counter per thread.
+void benchAtomics(const vector<int>& threadCounts)
+{
+  int maxThreads = threadCounts.back();
+  long long n = opsPerThread;
+
+  vector<int> zBuffer(maxThreads * TILE_PIXELS);
+  vector<int> expected(maxThreads * TILE_PIXELS);
+  vector<PaddedInt> counters(maxThreads);
+
+  for(int mode = 0; mode < 2; mode++)
+  {
+    bool isShared = (mode == 0);
+
+    for(unsigned c = 0; c < threadCounts.size(); c++)
+    {
+      int T = threadCounts[c];
+      int tiles = isShared ? 1 : T;
+
+      measure(isShared ? "atomicMin.same_tile" : "atomicMin.private_tile", T, T * n,
+          [&]()
+          {
+            for(int i = 0; i < tiles * TILE_PIXELS; i++)
+              zBuffer[i] = expected[i] = INT_MAX;
+          },
+          [&](int t)
+          {
+            int* tile = &zBuffer[isShared ? 0 : t * TILE_PIXELS];
+            unsigned seed = t + 1;
+            for(long long i = 0; i < n; i++)
+              piko::atomicMin(&tile[i % TILE_PIXELS], nextRandom(seed));
+          },
+          [&]()
+          {
+            // replay the same depths serially
+            for(int t = 0; t < T; t++)
+            {
+              int* tile = &expected[isShared ? 0 : t * TILE_PIXELS];
+              unsigned seed = t + 1;
+              for(long long i = 0; i < n; i++)
+                tile[i % TILE_PIXELS] = min(tile[i % TILE_PIXELS], (int) nextRandom(seed));
+            }
+            long long lost = 0;
+            for(int i = 0; i < tiles * TILE_PIXELS; i++)
+              lost += (zBuffer[i] != expected[i]);
+            return lost;
+          });
+
+      measure(isShared ? "atomicAdd.shared" : "atomicAdd.private", T, T * n,
+          [&]()
+          {
+            for(int t = 0; t < T; t++)
+              counters[t].v = 0;
+          },
+          [&](int t)
+          {
+            int* counter = &counters[isShared ? 0 : t].v;
+            for(long long i = 0; i < n; i++)
+              piko::atomicAdd(counter, 1);
+          },
+          [&]()
+          {
+            long long lost = 0;
+            if(isShared)
+              lost = T * n - counters[0].v;
+            else
+              for(int t = 0; t < T; t++)
+                lost += n - counters[t].v;
+            return lost;
+          });
+    }
+  }
+}
+
+// Pixel writes of a drain stage: PikoScreen::assignBin called directly,
+// through the generated __emitSpecializationAssignBin*__ dispatch, and
+// through the generated emit() of the stage. Threads write disjoint rows,
+// as the bins of the raster stage do.
+void benchScreen(const vector<int>& threadCounts)
+{
+  PikoScreen& screen = piko_pipe.pikoScreen;
+  long long n = opsPerThread;
+
+  for(unsigned c = 0; c < threadCounts.size(); c++)
+  {
+    int T = threadCounts[c];
+    int rows = max(1, SCREEN_H / T);
+
+    auto pixelOf = [&](int t, long long i) -> Pixel
+    {
+      Pixel px;
+      px.pos.x = i % SCREEN_W;
+      px.pos.y = (t * rows + (i / SCREEN_W) % rows) % SCREEN_H;
+      px.color = i;
+      return px;
+    };
+    auto noSetup = []() {};
+    auto noCheck = []() { return -1LL; };
+
+    measure("screen.assignBin", T, T * n, noSetup,
+        [&](int t)
+        {
+          for(long long i = 0; i < n; i++)
+            screen.assignBin(pixelOf(t, i));
+        },
+        noCheck);
+
+    measure("emit.specialization", T, T * n, noSetup,
+        [&](int t)
+        {
+          for(long long i = 0; i < n; i++)
+            __emitSpecializationAssignBinMicroStage__(pixelOf(t, i), &screen, 0);
+        },
+        noCheck);
+
+    measure("emit.stage", T, T * n, noSetup,
+        [&](int t)
+        {
+          for(long long i = 0; i < n; i++)
+            piko_pipe.micro.emit(pixelOf(t, i), 0);
+        },
+        noCheck);
+  }
+}
+
+// The CPU runner spawns and joins pikoNumCPUThreads threads for every
+// parallel kernel. runner.spawn_join times that alone, runner.empty_frame a
+// run_single() of the pipeline without input, i.e. all of its kernel launches.
+void benchRunner()
+{
+  const int launches = 100;
+  measureSerial("runner.spawn_join", pikoNumCPUThreads, launches, [&]()
+  {
+    for(int l = 0; l < launches; l++)
+    {
+      vector<thread> cpuThreads;
+      for(unsigned t = 0; t < pikoNumCPUThreads; t++)
+        cpuThreads.push_back(thread([]() {}));
+      for(auto& t : cpuThreads)
+        t.join();
+    }
+  });
+
+  const int frames = 10;
+  piko_pipe.prepare();
+  measureSerial("runner.empty_frame", pikoNumCPUThreads, frames, [&]()
+  {
+    for(int f = 0; f < frames; f++)
+      piko_pipe.run_single();
+  });
+}
+
+void writeJSON(const char* filename)
+{
+  FILE* f = fopen(filename, "w");
+  if(!f)
+  {
+    printf("Unable to write benchmark results %s\n", filename);
+    return;
+  }
+
+  fprintf(f, "{\n");
+  fprintf(f, "  \"hardware_threads\": %u,\n", thread::hardware_concurrency());
+  fprintf(f, "  \"runner_threads\": %u,\n", pikoNumCPUThreads);
+  fprintf(f, "  \"reps\": %d,\n", numReps);
+  fprintf(f, "  \"results\": [\n");
+  for(unsigned i = 0; i < results.size(); i++)
+  {
+    const MicroResult& r = results[i];
+    fprintf(f, "    { \"name\": \"%s\", \"threads\": %d, \"ops\": %lld, \"ns_per_op\": ",
+        r.name.c_str(), r.threads, r.ops);
+    pikoWriteSummaryJSON(f, r.ns);
+    if(r.lost >= 0)
+      fprintf(f, ", \"lost_updates\": %lld", r.lost);
+    fprintf(f, " }%s\n", (i + 1 < results.size()) ? "," : "");
+  }
+  fprintf(f, "  ]\n");
+  fprintf(f, "}\n");
+  fclose(f);
+  printf("Wrote benchmark results to %s\n", filename);
+}
+
+int main(int argc, char* argv[])
+{
+  int maxThreads = max(1u, thread::hardware_concurrency());
+  const char* jsonFile = "pikomicrobench.json";
+
+  for(int i = 1; i < argc; i++)
+  {
+    string arg = argv[i];
+    if(arg.substr(0, 10) == "--threads=")
+      maxThreads = atoi(arg.substr(10).c_str());
+    else if(arg.substr(0, 7) == "--reps=")
+      numReps = atoi(arg.substr(7).c_str());
+    else if(arg.substr(0, 6) == "--ops=")
+      opsPerThread = atoll(arg.substr(6).c_str());
+    else if(arg.substr(0, 9) == "--filter=")
+      filter = arg.substr(9);
+    else if(arg.substr(0, 7) == "--json=")
+      jsonFile = argv[i] + 7;
+    else
+    {
+      maxThreads = 0;
+      break;
+    }
+  }
+
+  if(maxThreads <= 0 || numReps <= 0 || opsPerThread <= 0)
+  {
+    printf("Usage: %s [--threads=N] [--reps=N] [--ops=N] [--filter=prefix] [--json=out.json]\n",
+        argv[0]);
+    return 1;
+  }
+
+  // 1, 2, 4, ... threads up to and including maxThreads
+  vector<int> threadCounts;
+  for(int t = 1; t < maxThreads; t *= 2)
+    threadCounts.push_back(t);
+  threadCounts.push_back(maxThreads);
+
+  ConstantState constState;
+  memset(&constState, 0, sizeof(constState));
+  constState.screenSizeX = SCREEN_W;
+  constState.screenSizeY = SCREEN_H;
+  MutableState mutableState;
+  memset(&mutableState, 0, sizeof(mutableState));
+  pikoAllocateMutableState(mutableState, constState, 1 << PIKO_BUF_VIS);
+
+  // no input: run_single() launches every kernel on empty bins
+  micro_prim noInput = makePrim(0);
+  piko_pipe.allocate(constState, mutableState, &noInput, 0);
+
+  printf("%-28s %7s %10s %9s %9s %9s %9s\n", "(nsec per op)", "threads", "ops",
+      "mean", "median", "p95", "lost");
+  benchBins(threadCounts);
+  benchAtomics(threadCounts);
+  benchScreen(threadCounts);
+  benchRunner();
+
+  piko_pipe.destroy();
+  pikoFreeMutableState(mutableState);
+
+  writeJSON(jsonFile);
+  return 0;
+}
+
+#endif // __PIKOC_HOST__
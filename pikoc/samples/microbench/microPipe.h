@@ -0,0 +1,41 @@
+#ifndef MICRO_PIPE_H_
+#define MICRO_PIPE_H_
+
+#include "piko/pipe.h"
+
+#include "microTypes.h"
+#include "micro.pikostage"
+
+#ifdef __PIKOC_HOST__
+
+class MicroPipe : public PikoPipe
+{
+public:
+  // public so that the benchmarks can call its generated emit()
+  MicroStage micro;
+
+  // host-side
+  ConstantState*      constState_;
+  MutableState*       mutableState_;
+  int         count_;
+  PikoScreen  pikoScreen;
+  PikoArray<micro_prim> h_input;
+
+#ifdef __PIKO_DEVICE_MEMBERS__
+  __PIKO_DEVICE_MEMBERS__
+#endif
+
+  MicroPipe()
+  {
+  }
+
+  void run        (ConstantState& constState, MutableState& mutableState, micro_prim* input, int count);
+  void allocate   (ConstantState& constState, MutableState& mutableState, micro_prim* input, int count);
+  void prepare    ();
+  void run_single ();
+  void destroy    ();
+};
+
+#endif // __PIKOC_HOST__
+
+#endif // MICRO_PIPE_H_
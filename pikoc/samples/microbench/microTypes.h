@@ -0,0 +1,13 @@
+#pragma once
+
+#include "piko/deviceFunctions.h"
+#include "piko/stage.h"
+#include "piko/builtinTypes.h"
+
+// A pixel-sized primitive: the microbenchmarks measure the runtime, not the
+// cost of copying large primitives
+struct micro_prim : public Primitive
+{
+  int x, y;
+  unsigned color;
+};
@@ -17,6 +17,7 @@ struct raster_wtri : public Primitive
 
   raster_wtri& operator=(raster_wtri& p)
   {
+    id = p.id;
     worldPos0 = p.worldPos0;
     worldPos1 = p.worldPos1;
     worldPos2 = p.worldPos2;
@@ -33,6 +34,84 @@ struct raster_wtri : public Primitive
   }  // end operator =
 };
 
+// A record of indexed input (RASTER_INDEXED): vertex id of the vertex buffer
+// and triangle id of the index buffer, packed together so that one input
+// array carries both. A record has no vertex if id >= numVertices of the
+// MutableState, and no triangle if i0 < 0.
+struct raster_ivtx : public Primitive
+{
+  int id;
+  cvec3f worldPos;
+  cvec3f normal;
+  int i0, i1, i2;
+
+  raster_ivtx& operator=(raster_ivtx& p)
+  {
+    id = p.id;
+    worldPos = p.worldPos;
+    normal = p.normal;
+    i0 = p.i0; i1 = p.i1; i2 = p.i2;
+    return *this;
+  }  // end operator =
+};
+
+// A triangle of indexed input, by the ids of its vertices
+struct raster_itri : public Primitive
+{
+  int id;
+  int i0, i1, i2;
+
+  raster_itri& operator=(raster_itri& p)
+  {
+    id = p.id;
+    i0 = p.i0; i1 = p.i1; i2 = p.i2;
+    return *this;
+  }  // end operator =
+};
+
+// A meshlet of meshlet input (RASTER_MESHLETS): count records of indexed
+// input from first on in MutableState::geometryBuffer, which hold the
+// vertices and triangles of the meshlet, and the bounds that cull it. Every
+// triangle lies in the sphere (center, radius), and its normal is within an
+// angle a of coneAxis, where coneCutoff is sin(a), or 1 if a is 90 degrees
+// or more.
+struct raster_meshlet : public Primitive
+{
+  int id;
+  cvec3f center;
+  float radius;
+  cvec3f coneAxis;
+  float coneCutoff;
+  int first, count;
+
+  raster_meshlet& operator=(raster_meshlet& p)
+  {
+    id = p.id;
+    center = p.center;
+    radius = p.radius;
+    coneAxis = p.coneAxis;
+    coneCutoff = p.coneCutoff;
+    first = p.first; count = p.count;
+    return *this;
+  }  // end operator =
+};
+
+// A transformed vertex of MutableState::vertexBuffer
+struct raster_tvtx
+{
+  int x, y;   // 28.4 fixed point
+  float z;
+#ifdef GORAUD
+  unsigned icol;
+#else
+  cvec2f normal;
+#endif
+};
+
+struct boundingBoxFixPt {
+  cvec2i hi, lo;
+};
+
 struct raster_stri : public Primitive
 {
   //cvec3f screenPos0, screenPos1, screenPos2;
@@ -70,6 +149,45 @@ struct raster_stri : public Primitive
   }  // end operator =
 };
 
-struct boundingBoxFixPt {
-  cvec2i hi, lo;
+// Edge from (x0, y0) to (x0 + dx, y0 + dy), in 28.4 fixed point. Its edge
+// function (y - y0) * dx - (x - x0) * dy is stored as y * dx - x * dy + c
+struct raster_edge
+{
+  int dx, dy;
+  int c;
+};
+
+// Triangle setup computed once per triangle by VertexShaderStage, which
+// RasterStage only evaluates in every bin the triangle touches
+struct raster_setup : public Primitive
+{
+  raster_edge edge0, edge1, edge2;  // v0->v1, v1->v2, v2->v0
+  boundingBoxFixPt bb;              // rounded out to whole pixels
+  float onebybary;                  // scales edge1/edge2 to alpha/beta
+  float z2, z0mz2, z1mz2;           // depth plane
+  int zLo, zHi;                     // bounds of the fragment depths, in depth test order
+  int id;                           // of the input triangle, see MutableState::visBuffer
+#ifdef GORAUD
+  cvec3f col2, col0mcol2, col1mcol2;
+#else
+  cvec2f normal0, normal1, normal2;
+#endif
+
+  raster_setup& operator=(raster_setup& p)
+  {
+    edge0 = p.edge0; edge1 = p.edge1; edge2 = p.edge2;
+    bb = p.bb;
+    onebybary = p.onebybary;
+    z2 = p.z2; z0mz2 = p.z0mz2; z1mz2 = p.z1mz2;
+    zLo = p.zLo; zHi = p.zHi;
+    id = p.id;
+#ifdef GORAUD
+    col2 = p.col2; col0mcol2 = p.col0mcol2; col1mcol2 = p.col1mcol2;
+#else
+    normal0     = p.normal0;
+    normal1     = p.normal1;
+    normal2     = p.normal2;
+#endif
+    return *this;
+  }  // end operator =
 };
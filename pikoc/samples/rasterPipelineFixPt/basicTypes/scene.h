@@ -5,6 +5,9 @@
 typedef unsigned int uint;
 #endif
 
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
 #include <iostream>
 #include <vector>
 
@@ -19,6 +22,25 @@ using namespace std;
 #define DeleteIfNotNull(x)       {if(x!=NULL){delete    x ; x=NULL;}}
 #define DeleteArrayIfNotNull(x)  {if(x!=NULL){delete [] x ; x=NULL;}}
 
+// limits of a meshlet
+#define MESHLET_MAX_VERTICES   64
+#define MESHLET_MAX_TRIANGLES  128
+
+// A cluster of numTriangles triangles of the flattened scene, from
+// firstTriangle on, with at most MESHLET_MAX_VERTICES vertices. Every
+// triangle lies in the sphere (center, radius), and its normal
+// cross(v1 - v0, v2 - v0) is within an angle a of coneAxis, where coneCutoff
+// is sin(a), or 1 if a is 90 degrees or more.
+struct meshlet
+{
+  int    firstTriangle;
+  int    numTriangles;
+  cvec3f center;
+  float  radius;
+  cvec3f coneAxis;
+  float  coneCutoff;
+};
+
 class scene 
 {
   camera                  _cam;
@@ -38,10 +60,16 @@ public:
   int                     _flatnTriangles;
   int                     _flatnPatches;
 
+  meshlet*                _flatMeshlets;
+  int                     _flatnMeshlets;
+
   scene(){
     _flattVertices  = NULL;
     _flattNormals   = NULL;
     _flatTriangles  = NULL;
+    _flatPatches    = NULL;
+    _flatMeshlets   = NULL;
+    _flatnMeshlets  = 0;
   }
 
   scene(const scene& sc){
@@ -58,6 +86,28 @@ public:
     DeleteArrayIfNotNull(_flattNormals);
     DeleteArrayIfNotNull(_flatTriangles);
     DeleteArrayIfNotNull(_flatPatches);
+    DeleteArrayIfNotNull(_flatMeshlets);
+  }
+
+  // releases all assets, so that another scene file can be parsed into
+  // this scene. The camera is kept: scene files set it when they have one.
+  inline void clear(){
+    for(unsigned int i = 0; i<_meshes.size(); i++){
+      DeleteIfNotNull(_meshes[i]);
+    }
+    for(unsigned int i = 0; i<_bezmeshes.size(); i++){
+      DeleteIfNotNull(_bezmeshes[i]);
+    }
+    _meshes.clear();
+    _bezmeshes.clear();
+    _lights.clear();
+    _mats.clear();
+
+    DeleteArrayIfNotNull(_flattVertices);
+    DeleteArrayIfNotNull(_flattNormals);
+    DeleteArrayIfNotNull(_flatTriangles);
+    DeleteArrayIfNotNull(_flatPatches);
+    DeleteArrayIfNotNull(_flatMeshlets);
   }
 
   inline void addMesh(trimesh* m){
@@ -195,6 +245,109 @@ public:
         flatPidx++;
       } // next patch
     } // next bezmesh
+
+    buildMeshlets();
+  }
+
+  // Splits the triangles of every mesh, in their order, into meshlets. They
+  // are as compact as that order is, as it is in most mesh files.
+  inline void buildMeshlets(){
+    vector<meshlet> meshlets;
+    // the last meshlet that counted each vertex
+    vector<int> vertexMeshlet(_flatnVertices, -1);
+
+    int flatTidx = 0;
+    for(uint mi = 0; mi < _meshes.size(); mi++){
+      int meshTend = flatTidx + _meshes[mi]->tris().size();
+      while(flatTidx < meshTend){
+        int meshletID = meshlets.size();
+        int numVertices = 0;
+
+        meshlet m;
+        m.firstTriangle = flatTidx;
+        m.numTriangles  = 0;
+        while(flatTidx < meshTend && m.numTriangles < MESHLET_MAX_TRIANGLES){
+          const cvec4i& t = _flatTriangles[flatTidx];
+          int v[3] = {t.x, t.y, t.z};
+
+          int newVertices = 0;
+          for(int k = 0; k < 3; k++){
+            if(vertexMeshlet[v[k]] != meshletID && (k < 1 || v[k] != v[0]) && (k < 2 || v[k] != v[1]))
+              newVertices++;
+          }
+          if(numVertices + newVertices > MESHLET_MAX_VERTICES)
+            break;
+
+          for(int k = 0; k < 3; k++)
+            vertexMeshlet[v[k]] = meshletID;
+          numVertices += newVertices;
+          m.numTriangles++;
+          flatTidx++;
+        }
+
+        computeMeshletBounds(m);
+        meshlets.push_back(m);
+      }
+    }
+
+    DeleteArrayIfNotNull(_flatMeshlets);
+    _flatnMeshlets = meshlets.size();
+    _flatMeshlets  = new meshlet[_flatnMeshlets];
+    for(int i = 0; i < _flatnMeshlets; i++)
+      _flatMeshlets[i] = meshlets[i];
+  }
+
+  inline void computeMeshletBounds(meshlet& m){
+    int tBeg = m.firstTriangle;
+    int tEnd = m.firstTriangle + m.numTriangles;
+
+    cvec3f bbmin = gencvec3f( FLT_MAX, FLT_MAX, FLT_MAX);
+    cvec3f bbmax = gencvec3f(-FLT_MAX,-FLT_MAX,-FLT_MAX);
+    for(int ti = tBeg; ti < tEnd; ti++){
+      int v[3] = {_flatTriangles[ti].x, _flatTriangles[ti].y, _flatTriangles[ti].z};
+      for(int k = 0; k < 3; k++){
+        const cvec3f& p = _flattVertices[v[k]];
+        bbmin = gencvec3f(min(bbmin.x, p.x), min(bbmin.y, p.y), min(bbmin.z, p.z));
+        bbmax = gencvec3f(max(bbmax.x, p.x), max(bbmax.y, p.y), max(bbmax.z, p.z));
+      }
+    }
+
+    m.center = (bbmin + bbmax) * 0.5f;
+    m.radius = 0.0f;
+    for(int ti = tBeg; ti < tEnd; ti++){
+      int v[3] = {_flatTriangles[ti].x, _flatTriangles[ti].y, _flatTriangles[ti].z};
+      for(int k = 0; k < 3; k++)
+        m.radius = max(m.radius, magvec(_flattVertices[v[k]] - m.center));
+    }
+
+    // the axis is the mean of the normals of the triangles with an area, and
+    // the cone the smallest around it that holds them all
+    vector<cvec3f> normals;
+    cvec3f axis = gencvec3f(0.0f, 0.0f, 0.0f);
+    for(int ti = tBeg; ti < tEnd; ti++){
+      const cvec3f& p0 = _flattVertices[_flatTriangles[ti].x];
+      const cvec3f& p1 = _flattVertices[_flatTriangles[ti].y];
+      const cvec3f& p2 = _flattVertices[_flatTriangles[ti].z];
+      cvec3f n = cross(p1 - p0, p2 - p0);
+      if(magsqr(n) > 0.0f){
+        normalizeInplace(n);
+        normals.push_back(n);
+        axis += n;
+      }
+    }
+
+    m.coneAxis   = gencvec3f(0.0f, 0.0f, 1.0f);
+    m.coneCutoff = 1.0f;
+    if(magsqr(axis) > 0.0f){
+      normalizeInplace(axis);
+      m.coneAxis = axis;
+
+      float minDot = 1.0f;
+      for(uint i = 0; i < normals.size(); i++)
+        minDot = min(minDot, dotvec(axis, normals[i]));
+      if(minDot > 0.0f)
+        m.coneCutoff = sqrtf(1.0f - minDot * minDot);
+    }
   }
 
 };
@@ -0,0 +1,226 @@
+#ifndef HOST_PRETRANSFORM_H
+#define HOST_PRETRANSFORM_H
+
+// Host transform and lighting of the scene for VTX_PRETRANSFORM. Every
+// vertex is transformed and lit once, however many triangles share it, and
+// the triangles then only copy their vertices. Both passes are split over
+// pikoGetNumCPUThreads() threads, and with AVX2 (-mavx2 in the host compile)
+// vertices are done eight at a time.
+//
+// The results are bit-identical to the scalar code: the same single-precision
+// operations in the same order and the same comparisons, as long as the
+// compiler contracts no multiply-add to an FMA. The sample Makefile builds
+// the host code with -ffp-contract=off for that (HOST_FPFLAGS); clang also
+// honors the pragma below.
+
+#ifdef __clang__
+#pragma STDC FP_CONTRACT OFF
+#endif
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "piko/matrices.h"
+#include "piko/threads.h"
+#include "host_math.h"
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+// vertices a thread gets at least
+#define HOST_PRETRANSFORM_GRAIN 4096
+
+struct hostPretransformParams
+{
+  const float* viewProjMatrix;
+  float halfW, halfH;
+  cvec3f eye;
+};
+
+inline void saturatePixelHost(cvec3f& _p)
+{
+  _p.x = _p.x > 1.0f ? 1.0f : (_p.x < 0.0f ? 0.0f : _p.x);
+  _p.y = _p.y > 1.0f ? 1.0f : (_p.y < 0.0f ? 0.0f : _p.y);
+  _p.z = _p.z > 1.0f ? 1.0f : (_p.z < 0.0f ? 0.0f : _p.z);
+}
+
+inline cvec3f computeLightingHost(const cvec3f& _mynor, cvec3f& _lightvec, cvec3f& _matcol)
+{
+  cvec3f out;
+  float _diffuse =
+  _mynor.x * _lightvec.x + _mynor.y * _lightvec.y + _mynor.z * _lightvec.z;
+  _diffuse = _diffuse < 0.0f ? 0.0f : (_diffuse );
+  out.x = (_diffuse * _matcol.x + 0.15f);
+  out.y = (_diffuse * _matcol.y + 0.15f);
+  out.z = (_diffuse * _matcol.z + 0.30f);
+  saturatePixelHost(out);
+  return out;
+}
+
+inline unsigned toABGRHost(cvec3f color)
+{
+  return ((255<<24) | ((unsigned)(color.z*255.0f)<<16) | ((unsigned)(color.y*255.0f)<<8) | (unsigned)(color.x*255.0f));
+}
+
+// Normalizes nor in place, and returns the screen position and color of
+// the vertex at pos
+inline void pretransformVertex(const hostPretransformParams& prm, const cvec3f& pos, cvec3f& nor,
+  cvec3f& outPos, unsigned& outCol)
+{
+  nor = HOST::normalize(nor);
+
+  cvec3f lightvec = prm.eye - pos;
+  normalizeInplace(lightvec);
+
+  cvec4f tv;
+  vtransform(prm.viewProjMatrix, pos, tv);
+  float onebyw = 1.0f / tv.w;
+  outPos.x = (tv.x * onebyw + 1.0f) * prm.halfW;
+  outPos.y = (tv.y * onebyw + 1.0f) * prm.halfH;
+  outPos.z = (tv.z * onebyw );
+
+  cvec3f matcol = gencvec3f(0.9000f, 0.9000f, 0.6000f);
+  outCol = toABGRHost(computeLightingHost(nor, lightvec, matcol));
+}
+
+#ifdef __AVX2__
+
+// (a < b) ? c : x, per lane
+inline __m256 hostSelectLT(__m256 a, __m256 b, __m256 c, __m256 x)
+{
+  return _mm256_blendv_ps(x, c, _mm256_cmp_ps(a, b, _CMP_LT_OQ));
+}
+
+// saturatePixelHost() of one component
+inline __m256 hostSaturate(__m256 c)
+{
+  __m256 zero = _mm256_setzero_ps();
+  __m256 one  = _mm256_set1_ps(1.0f);
+  return hostSelectLT(one, c, one, hostSelectLT(c, zero, zero, c));
+}
+
+// pretransformVertex() of vertices [0, 8) of pos and nor
+inline void pretransformVertices8(const hostPretransformParams& prm, const cvec3f* pos, cvec3f* nor,
+  cvec3f* outPos, unsigned* outCol)
+{
+  const float* m = prm.viewProjMatrix;
+  __m256i stride = _mm256_setr_epi32(0, 3, 6, 9, 12, 15, 18, 21);
+  __m256 zero = _mm256_setzero_ps();
+  __m256 one  = _mm256_set1_ps(1.0f);
+
+  __m256 px = _mm256_i32gather_ps(&pos[0].x, stride, 4);
+  __m256 py = _mm256_i32gather_ps(&pos[0].y, stride, 4);
+  __m256 pz = _mm256_i32gather_ps(&pos[0].z, stride, 4);
+  __m256 nx = _mm256_i32gather_ps(&nor[0].x, stride, 4);
+  __m256 ny = _mm256_i32gather_ps(&nor[0].y, stride, 4);
+  __m256 nz = _mm256_i32gather_ps(&nor[0].z, stride, 4);
+
+  // HOST::normalize(): divide by the magnitude
+  __m256 nmag = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(
+    _mm256_mul_ps(nx, nx), _mm256_mul_ps(ny, ny)), _mm256_mul_ps(nz, nz)));
+  nx = _mm256_div_ps(nx, nmag);
+  ny = _mm256_div_ps(ny, nmag);
+  nz = _mm256_div_ps(nz, nmag);
+
+  // normalizeInplace(): scale by the reciprocal of a nonzero magnitude
+  __m256 lx = _mm256_sub_ps(_mm256_set1_ps(prm.eye.x), px);
+  __m256 ly = _mm256_sub_ps(_mm256_set1_ps(prm.eye.y), py);
+  __m256 lz = _mm256_sub_ps(_mm256_set1_ps(prm.eye.z), pz);
+  __m256 lmag = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(
+    _mm256_mul_ps(lx, lx), _mm256_mul_ps(ly, ly)), _mm256_mul_ps(lz, lz)));
+  __m256 lrcp = _mm256_div_ps(one, lmag);
+  __m256 lnonzero = _mm256_cmp_ps(lmag, zero, _CMP_NEQ_UQ);
+  lx = _mm256_blendv_ps(lx, _mm256_mul_ps(lx, lrcp), lnonzero);
+  ly = _mm256_blendv_ps(ly, _mm256_mul_ps(ly, lrcp), lnonzero);
+  lz = _mm256_blendv_ps(lz, _mm256_mul_ps(lz, lrcp), lnonzero);
+
+  // vtransform() and the viewport
+  __m256 t[4];
+  for(int r = 0; r < 4; r++)
+  {
+    t[r] = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(
+      _mm256_mul_ps(px, _mm256_set1_ps(m[r])),
+      _mm256_mul_ps(py, _mm256_set1_ps(m[r + 4]))),
+      _mm256_mul_ps(pz, _mm256_set1_ps(m[r + 8]))),
+      _mm256_set1_ps(m[r + 12]));
+  }
+  __m256 onebyw = _mm256_div_ps(one, t[3]);
+  __m256 sx = _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(t[0], onebyw), one), _mm256_set1_ps(prm.halfW));
+  __m256 sy = _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(t[1], onebyw), one), _mm256_set1_ps(prm.halfH));
+  __m256 sz = _mm256_mul_ps(t[2], onebyw);
+
+  // computeLightingHost() and toABGRHost()
+  __m256 diffuse = _mm256_add_ps(_mm256_add_ps(
+    _mm256_mul_ps(nx, lx), _mm256_mul_ps(ny, ly)), _mm256_mul_ps(nz, lz));
+  diffuse = hostSelectLT(diffuse, zero, zero, diffuse);
+
+  __m256 s255 = _mm256_set1_ps(255.0f);
+  __m256i ix = _mm256_cvttps_epi32(_mm256_mul_ps(hostSaturate(
+    _mm256_add_ps(_mm256_mul_ps(diffuse, _mm256_set1_ps(0.9000f)), _mm256_set1_ps(0.15f))), s255));
+  __m256i iy = _mm256_cvttps_epi32(_mm256_mul_ps(hostSaturate(
+    _mm256_add_ps(_mm256_mul_ps(diffuse, _mm256_set1_ps(0.9000f)), _mm256_set1_ps(0.15f))), s255));
+  __m256i iz = _mm256_cvttps_epi32(_mm256_mul_ps(hostSaturate(
+    _mm256_add_ps(_mm256_mul_ps(diffuse, _mm256_set1_ps(0.6000f)), _mm256_set1_ps(0.30f))), s255));
+  __m256i color = _mm256_or_si256(_mm256_set1_epi32(255 << 24),
+    _mm256_or_si256(_mm256_slli_epi32(iz, 16),
+      _mm256_or_si256(_mm256_slli_epi32(iy, 8), ix)));
+  _mm256_storeu_si256((__m256i*) outCol, color);
+
+  float fx[8], fy[8], fz[8], gx[8], gy[8], gz[8];
+  _mm256_storeu_ps(fx, sx);
+  _mm256_storeu_ps(fy, sy);
+  _mm256_storeu_ps(fz, sz);
+  _mm256_storeu_ps(gx, nx);
+  _mm256_storeu_ps(gy, ny);
+  _mm256_storeu_ps(gz, nz);
+  for(int i = 0; i < 8; i++)
+  {
+    outPos[i] = gencvec3f(fx[i], fy[i], fz[i]);
+    nor[i]    = gencvec3f(gx[i], gy[i], gz[i]);
+  }
+}
+
+#endif // __AVX2__
+
+// pretransformVertex() of vertices [begin, end)
+inline void pretransformVertices(const hostPretransformParams& prm, const cvec3f* pos, cvec3f* nor,
+  int begin, int end, cvec3f* outPos, unsigned* outCol)
+{
+  int i = begin;
+#ifdef __AVX2__
+  for(; i + 8 <= end; i += 8)
+    pretransformVertices8(prm, &pos[i], &nor[i], &outPos[i], &outCol[i]);
+#endif
+  for(; i < end; i++)
+    pretransformVertex(prm, pos[i], nor[i], outPos[i], outCol[i]);
+}
+
+// Calls f(begin, end) on contiguous ranges that cover [0, n), on up to
+// pikoGetNumCPUThreads() threads
+template<class F>
+void hostParallelFor(int n, F f)
+{
+  int numThreads = std::min((int) pikoGetNumCPUThreads(),
+    (n + HOST_PRETRANSFORM_GRAIN - 1) / HOST_PRETRANSFORM_GRAIN);
+  if(numThreads <= 1)
+  {
+    f(0, n);
+    return;
+  }
+
+  std::vector<std::thread> threads;
+  for(int t = 0; t < numThreads; t++)
+  {
+    int begin = (int)((long long) n * t / numThreads);
+    int end   = (int)((long long) n * (t + 1) / numThreads);
+    threads.push_back(std::thread(f, begin, end));
+  }
+  for(int t = 0; t < numThreads; t++)
+    threads[t].join();
+}
+
+#endif // HOST_PRETRANSFORM_H
@@ -5,6 +5,7 @@ typedef unsigned int uint;
 #include <iostream>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 
 #include "rasterPipe.h"
 #include "__pikoCompiledPipe.h"
@@ -13,10 +14,26 @@ typedef unsigned int uint;
 
 #include <piko/builtinTypes.h>
 #include "host_math.h"
+#include "hostPretransform.h"
 #include "pikoTypes.h"
 #include "rasterMacros.h"
 
 #include "common_code/FPSMeter.h"
+#include "hostMatrix.h"
+
+// headless builds (pikoc --headless) write the frame to a file instead of
+// opening a GLUT window
+#ifdef __PIKOC_HEADLESS__
+#include "frameWriter.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#else
+#include <GL/glut.h>
+#endif // __PIKOC_HEADLESS__
 
 // pikoc does not work well with assimp, so it will not be included when pikoc runs
 #ifndef __PIKOC__
@@ -41,15 +58,24 @@ using namespace std;
 void initScreen(int W, int H);
 void initScene(int argc, char* argv[]);
 void initPipe();
-void display();
 void destroyApp();
 void doPerfTest(int n_runs = 10);
+#ifdef __PIKOC_HEADLESS__
+void writeFrame(const char* filename);
+#ifdef __PIKOC_BENCH__
+int runBenchmark(int argc, char* argv[]);
+#endif // __PIKOC_BENCH__
+#else
+void display();
 void mouseHandler(int button, int state, int x, int y);
 void keypressed(unsigned char key, int x, int y);
+#endif // __PIKOC_HEADLESS__
 
 // camera helper functions here
 void buildProjectionMatrix();
 void loadTriangleBuffer(int start, int end);
+void loadIndexedBuffer(int numTriangles);
+void loadMeshletBuffer(int numTriangles);
 void resetDepthBuffer();
 void findCameraZrange();
 
@@ -66,6 +92,16 @@ float theta, phi, camdist;
 
 raster_wtri* triangleBuffer = NULL;
 
+// RASTER_INDEXED input: the vertices and triangles of the scene, and the
+// number of records that hold them
+raster_ivtx* indexedBuffer = NULL;
+int nIndexed = 0;
+
+// RASTER_MESHLETS input: the meshlets of the scene, whose vertices and
+// triangles are in indexedBuffer
+raster_meshlet* meshletBuffer = NULL;
+int nMeshlets = 0;
+
 // state
 ConstantState pipelineConstantState;
 MutableState pipelineMutableState;
@@ -83,6 +119,20 @@ RasterPipe piko_pipe;
 
 int main(int argc, char* argv[])
 {
+#if defined(__PIKOC_BENCH__) && defined(__PIKOC_HEADLESS__)
+  return runBenchmark(argc, argv);
+#elif defined(__PIKOC_HEADLESS__)
+  initScreen(Width, Height);
+  initScene(argc, argv);
+  initPipe();
+  doPerfTest(n_test_runs);
+  writeFrame("pikoraster.bmp");
+#ifdef __PIKOC_INSTRUMENT__
+  piko_pipe.getStats().print();
+#endif // __PIKOC_INSTRUMENT__
+  destroyApp();
+  return 0;
+#else
   glutInit(&argc, argv);
   initScreen(Width, Height); 
   initScene(argc, argv);
@@ -91,6 +141,7 @@ int main(int argc, char* argv[])
   doPerfTest(n_test_runs);
   atexit(destroyApp);
   glutMainLoop();
+#endif // __PIKOC_HEADLESS__
 }
 
 void initScreen(int W, int H)
@@ -106,12 +157,14 @@ void initScreen(int W, int H)
   pipelineConstantState.halfW = 0.5f * (float)W;
   pipelineConstantState.halfH = 0.5f * (float)H;
 
+#ifndef __PIKOC_HEADLESS__
   glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGBA | GLUT_DEPTH);
   glutInitWindowSize(W,H);
   glutCreateWindow("Raster Pipeline");
   glutMouseFunc(mouseHandler);
   glutKeyboardFunc(keypressed);
   glClearColor(0.0f, 0.0f, 0.2f, 1.0f);
+#endif // __PIKOC_HEADLESS__
 }
 
 
@@ -164,11 +217,380 @@ void initPipe()
   //   pipelineState.lightColor = gencvec3f(1.0,1.0,1.0);
   // }
 
+#if defined(RASTER_MESHLETS)
+  loadMeshletBuffer(nTris);
+#elif defined(RASTER_INDEXED)
+  loadIndexedBuffer(nTris);
+#else
   loadTriangleBuffer(0, nTris);
+#endif
+
+  // the depth buffers are sized to the current screen
+#ifdef RASTER_DEFERRED
+  pikoAllocateMutableState(pipelineMutableState, pipelineConstantState);
+#else
+  // only deferred shading reads the visibility buffer
+  pikoAllocateMutableState(pipelineMutableState, pipelineConstantState, 1 << PIKO_BUF_VIS);
+#endif
   resetDepthBuffer();
+#if defined(RASTER_MESHLETS)
+  piko_pipe.allocate(pipelineConstantState, pipelineMutableState, meshletBuffer, nMeshlets);
+#elif defined(RASTER_INDEXED)
+  piko_pipe.allocate(pipelineConstantState, pipelineMutableState, indexedBuffer, nIndexed);
+#else
   piko_pipe.allocate(pipelineConstantState, pipelineMutableState, triangleBuffer, nTris);
+#endif
+}
+
+#ifdef __PIKOC_HEADLESS__
+
+void writeFrame(const char* filename)
+{
+  buildProjectionMatrix();
+  resetDepthBuffer();
+
+  piko_pipe.prepare();
+  piko_pipe.run_single();
+
+  int W = pipelineConstantState.screenSizeX;
+  int H = pipelineConstantState.screenSizeY;
+  unsigned* data = new unsigned[W * H];
+  piko_pipe.pikoScreen.readPixels(data);
+  writeFrameBMP(filename, data, W, H);
+  delete[] data;
+}
+
+#ifdef __PIKOC_BENCH__
+
+// ----------------------------------------
+// benchmark mode (pikoc --headless --bench)
+// ----------------------------------------
+
+struct benchCameraKey
+{
+  cvec3f eye, target, up;
+};
+
+// one key per line: eye.xyz target.xyz [up.xyz], '#' starts a comment
+bool loadCameraPath(const char* filename, vector<benchCameraKey>& path)
+{
+  ifstream in(filename);
+  if(!in.is_open())
+  {
+    printf("Unable to open camera path %s\n", filename);
+    return false;
+  }
+
+  string line;
+  while(getline(in, line))
+  {
+    if(line.find('#') != string::npos)
+      line = line.substr(0, line.find('#'));
+
+    stringstream ss(line);
+    benchCameraKey key;
+    if(!(ss >> key.eye.x >> key.eye.y >> key.eye.z
+            >> key.target.x >> key.target.y >> key.target.z))
+      continue;
+    if(!(ss >> key.up.x >> key.up.y >> key.up.z))
+      key.up = gencvec3f(0.0f, 1.0f, 0.0f);
+    path.push_back(key);
+  }
+
+  printf("Loaded %d camera keys from %s\n", (int)path.size(), filename);
+  return !path.empty();
+}
+
+// one scene file per line, '#' starts a comment
+bool loadSceneList(const char* filename, vector<string>& scenes)
+{
+  ifstream in(filename);
+  if(!in.is_open())
+  {
+    printf("Unable to open scene list %s\n", filename);
+    return false;
+  }
+
+  string line;
+  while(getline(in, line))
+  {
+    if(line.find('#') != string::npos)
+      line = line.substr(0, line.find('#'));
+
+    stringstream ss(line);
+    string name;
+    if(ss >> name)
+      scenes.push_back(name);
+  }
+  return true;
+}
+
+void setBenchCamera(const benchCameraKey& key)
+{
+  sMain.cam().eye()    = key.eye;
+  sMain.cam().target() = key.target;
+  sMain.cam().up()     = key.up;
+  buildProjectionMatrix();
+
+#ifdef VTX_PRETRANSFORM
+  // vertices are transformed on the host, so the input changes with the camera
+  loadTriangleBuffer(0, nTris);
+  piko_pipe.h_input.copyData(triangleBuffer, nTris);
+#endif
+}
+
+// mean times of one run of a thread sweep
+struct benchScalingPoint
+{
+  int threads;
+  double frameMs;
+  vector<double> stageMs;
+};
+
+// Speedup and parallel efficiency of a run against the first run of the
+// sweep. Weak scaling grows the work with the threads, so its efficiency is
+// the ratio of the times and its speedup is the scaled speedup.
+void benchScaling(const benchScalingPoint& base, int threads, double ms, double baseMs, bool weak,
+    double& speedup, double& efficiency)
+{
+  speedup = efficiency = 0.0;
+  if(ms <= 0.0 || baseMs <= 0.0)
+    return;
+
+  double ratio = (double)threads / base.threads;
+  efficiency = weak ? baseMs / ms : baseMs / (ms * ratio);
+  speedup = efficiency * ratio;
+}
+
+void printScaling(const string& scene, const string& scaling, const vector<benchScalingPoint>& points)
+{
+  bool weak = (scaling != "strong");
+
+  printf("\n%s scaling of %s (speedup, efficiency):\n", scaling.c_str(), scene.c_str());
+  printf("%-24s", "threads");
+  for(unsigned p = 0; p < points.size(); p++)
+    printf(" %13d", points[p].threads);
+  printf("\n");
+
+  for(int i = -1; i < pikoBench.getNumStages(); i++)
+  {
+    printf("%-24s", (i < 0) ? "frame" : pikoBench.getStageName(i));
+    for(unsigned p = 0; p < points.size(); p++)
+    {
+      double speedup, efficiency;
+      benchScaling(points[0], points[p].threads,
+          (i < 0) ? points[p].frameMs : points[p].stageMs[i],
+          (i < 0) ? points[0].frameMs : points[0].stageMs[i], weak, speedup, efficiency);
+      printf(" %6.2fx %4.0f%%", speedup, 100.0 * efficiency);
+    }
+    printf("\n");
+  }
+  printf("\n");
+}
+
+int runBenchmark(int argc, char* argv[])
+{
+  int warmupFrames = 10;
+  int measuredFrames = 100;
+  int maxThreads = 0;
+  string scaling;
+  const char* cameraFile = NULL;
+  const char* jsonFile = "pikobench.json";
+#ifdef __PIKOC_CAPTURE__
+  const char* captureFile = NULL;
+#endif // __PIKOC_CAPTURE__
+  vector<string> scenes;
+
+  for(int i = 1; i < argc; i++)
+  {
+    string arg = argv[i];
+    if(arg.substr(0, 9) == "--warmup=")
+      warmupFrames = atoi(arg.substr(9).c_str());
+    else if(arg.substr(0, 9) == "--frames=")
+      measuredFrames = atoi(arg.substr(9).c_str());
+    else if(arg.substr(0, 10) == "--threads=")
+      maxThreads = atoi(arg.substr(10).c_str());
+    else if(arg.substr(0, 10) == "--scaling=")
+      scaling = arg.substr(10);
+    else if(arg.substr(0, 9) == "--camera=")
+      cameraFile = argv[i] + 9;
+    else if(arg.substr(0, 7) == "--json=")
+      jsonFile = argv[i] + 7;
+#ifdef __PIKOC_CAPTURE__
+    else if(arg.substr(0, 10) == "--capture=")
+      captureFile = argv[i] + 10;
+#endif // __PIKOC_CAPTURE__
+    else if(arg.substr(0, 9) == "--scenes=")
+    {
+      if(!loadSceneList(argv[i] + 9, scenes))
+        return 1;
+    }
+    else if(arg.substr(0, 1) == "-")
+    {
+      printf("Usage: %s [--warmup=N] [--frames=N] [--threads=N] [--scaling=strong|weak|weak-screen]\n"
+             "          [--camera=path.txt] [--json=out.json] [--capture=frame.cap]\n"
+             "          [--scenes=list.txt] [scene ...]\n", argv[0]);
+      return 1;
+    }
+    else
+      scenes.push_back(arg);
+  }
+
+  if(scenes.empty())
+    scenes.push_back("fairyforest.scene");
+  if(measuredFrames <= 0)
+  {
+    printf("Nothing to measure: --frames must be at least 1\n");
+    return 1;
+  }
+  if(scaling != "" && scaling != "strong" && scaling != "weak" && scaling != "weak-screen")
+  {
+    printf("Unknown scaling mode %s: use strong, weak or weak-screen\n", scaling.c_str());
+    return 1;
+  }
+
+  // Without --scaling every scene runs once, on --threads or the default
+  // number of worker threads. With it, on 1, 2, 4, ... up to that number.
+  if(maxThreads <= 0)
+    maxThreads = pikoGetNumCPUThreads();
+  vector<int> threadCounts;
+  if(scaling != "")
+    for(int t = 1; t < maxThreads; t *= 2)
+      threadCounts.push_back(t);
+  threadCounts.push_back(maxThreads);
+
+  vector<benchCameraKey> cameraPath;
+  if(cameraFile != NULL && !loadCameraPath(cameraFile, cameraPath))
+    return 1;
+
+  FILE* json = fopen(jsonFile, "w");
+  if(!json)
+  {
+    printf("Unable to write benchmark results %s\n", jsonFile);
+    return 1;
+  }
+  fprintf(json, "[\n");
+  bool firstResult = true;
+
+  for(unsigned si = 0; si < scenes.size(); si++)
+  {
+    sMain.clear();
+    initScreen(Width, Height);
+
+    sceneParser scp;
+    scp.parseFile("../../..", scenes[si].c_str(), &sMain);
+    sMain.flatten(nTris, nVerts, nPatches);
+    int sceneTris = nTris;
+
+    vector<benchScalingPoint> points;
+    for(unsigned ti = 0; ti < threadCounts.size(); ti++)
+    {
+      int threads = threadCounts[ti];
+      pikoSetNumCPUThreads(threads);
+
+      // weak scaling: the input triangles, or the pixels, grow with the
+      // threads up to the whole scene at the full screen size
+      int W = Width, H = Height;
+      nTris = sceneTris;
+      if(scaling == "weak")
+        nTris = max(1, (int)((long long)sceneTris * threads / maxThreads));
+      else if(scaling == "weak-screen")
+      {
+        double f = sqrt((double)threads / maxThreads);
+        W = max(32, (int)(Width * f) / 32 * 32);
+        H = max(32, (int)(Height * f) / 32 * 32);
+      }
+
+      printf("Benchmarking %s on %d threads (%dx%d, %d triangles): %d warm-up and %d measured frames\n",
+          scenes[si].c_str(), threads, W, H, nTris, warmupFrames, measuredFrames);
+
+      initScreen(W, H);
+      buildProjectionMatrix();
+      initPipe();
+
+      for(int frame = 0; frame < warmupFrames + measuredFrames; frame++)
+      {
+        if(frame == warmupFrames)
+          pikoBench.discard();
+
+        if(!cameraPath.empty())
+          setBenchCamera(cameraPath[frame % cameraPath.size()]);
+        resetDepthBuffer();
+
+#ifdef __PIKOC_CAPTURE__
+        // the inputs of the first measured frame, for bin/pikoreplay
+        if(captureFile != NULL && frame == warmupFrames && ti == 0)
+        {
+          stringstream name;
+          name << captureFile;
+          if(scenes.size() > 1)
+            name << "." << si;
+          piko_pipe.writeCapture(name.str().c_str());
+        }
+#endif // __PIKOC_CAPTURE__
+
+        pikoBench.beginFrame();
+        piko_pipe.prepare();
+        piko_pipe.run_single();
+        pikoBench.endFrame();
+      }
+
+      pikoBench.print();
+
+      benchScalingPoint point;
+      point.threads = threads;
+      point.frameMs = pikoBench.frameSummary().mean;
+      for(int i = 0; i < pikoBench.getNumStages(); i++)
+        point.stageMs.push_back(pikoBench.stageSummary(i).mean);
+      points.push_back(point);
+
+      stringstream info;
+      info << "\"scene\": \"" << scenes[si] << "\", "
+           << "\"camera_path\": \"" << (cameraFile ? cameraFile : "") << "\", "
+           << "\"width\": " << W << ", \"height\": " << H << ", "
+           << "\"triangles\": " << nTris << ", \"warmup\": " << warmupFrames << ", "
+           << "\"threads\": " << threads;
+      if(scaling != "")
+      {
+        bool weak = (scaling != "strong");
+        double speedup, efficiency;
+        benchScaling(points[0], threads, point.frameMs, points[0].frameMs, weak, speedup, efficiency);
+        info << ", \"scaling\": \"" << scaling << "\", "
+             << "\"speedup\": " << speedup << ", \"efficiency\": " << efficiency;
+
+        stringstream stageSpeedup, stageEfficiency;
+        for(int i = 0; i < pikoBench.getNumStages(); i++)
+        {
+          benchScaling(points[0], threads, point.stageMs[i], points[0].stageMs[i], weak,
+              speedup, efficiency);
+          stageSpeedup << (i ? ", " : "") << speedup;
+          stageEfficiency << (i ? ", " : "") << efficiency;
+        }
+        info << ", \"stage_speedup\": [" << stageSpeedup.str() << "]"
+             << ", \"stage_efficiency\": [" << stageEfficiency.str() << "]";
+      }
+      if(!firstResult)
+        fprintf(json, ",\n");
+      firstResult = false;
+      pikoBench.writeJSON(json, "RasterPipe", info.str());
+
+      destroyApp();
+    }
+
+    if(scaling != "")
+      printScaling(scenes[si], scaling, points);
+  }
+
+  fprintf(json, "\n]\n");
+  fclose(json);
+  printf("Wrote benchmark results to %s\n", jsonFile);
+  return 0;
 }
 
+#endif // __PIKOC_BENCH__
+
+#else
+
 void display()
 {
   printf("display()\n");
@@ -192,6 +614,8 @@ void display()
   // }
 }
 
+#endif // __PIKOC_HEADLESS__
+
 void doPerfTest(int n_runs)
 {
   printf("Running perf test (%d runs)...\n", n_runs);
@@ -269,25 +693,23 @@ void buildProjectionMatrix()
 {
   camera& cam = sMain.cam();
 
-  glMatrixMode(GL_PROJECTION); 
-
   //printf("znear = %f, zfar = %f\n", cam.zNear(), cam.zFar());
 
-  glLoadIdentity();
-  gluPerspective(cam.fovyDeg(), cam.aspect(), cam.zNear(), cam.zFar());
-  glMatrixMode(GL_MODELVIEW);
-  glLoadIdentity();
-  gluLookAt(
+  // same matrices as gluPerspective and gluLookAt, without needing a GL context
+  float projMatrix[16];
+  hostMatIdentity(projMatrix);
+  hostMatPerspective(projMatrix, cam.fovyDeg(), cam.aspect(), cam.zNear(), cam.zFar());
+
+  hostMatIdentity(pipelineConstantState.viewMatrix);
+  hostMatLookAt(pipelineConstantState.viewMatrix,
       cam.eye().x,    cam.eye().y,    cam.eye().z,
       cam.target().x, cam.target().y, cam.target().z,
       cam.up().x,     cam.up().y,     cam.up().z);
 
-  glMatrixMode(GL_PROJECTION);
-  glPushMatrix();
-  glGetFloatv(GL_MODELVIEW_MATRIX, pipelineConstantState.viewMatrix);
-  glMultMatrixf( pipelineConstantState.viewMatrix);
-  glGetFloatv(GL_PROJECTION_MATRIX, pipelineConstantState.viewProjMatrix);
-  glPopMatrix();
+  memcpy(pipelineConstantState.viewProjMatrix, projMatrix, 16*sizeof(float));
+  hostMatMult(pipelineConstantState.viewProjMatrix, pipelineConstantState.viewMatrix);
+
+  pipelineConstantState.eyePos = cam.eye();
 
   // printf("final projection matrix:\n");
   // for(int i=0; i<16; i++) {
@@ -296,43 +718,6 @@ void buildProjectionMatrix()
   // } printf("\n");
 }
 
-void inPlaceTransform(cvec3f& v, float viewmat[16])
-{
-  cvec4f tv;
-  vtransform(viewmat, v, tv);
-  float onebyw = 1.0f / tv.w;
-  tv.x = (tv.x * onebyw + 1.0f) * pipelineConstantState.halfW;
-  tv.y = (tv.y * onebyw + 1.0f) * pipelineConstantState.halfH;
-  tv.z = (tv.z * onebyw );
-  v = gencvec3f(tv.x, tv.y, tv.z);
-}
-
-inline void saturatePixelHost(cvec3f& _p) 
-{
-  _p.x = _p.x > 1.0f ? 1.0f : (_p.x < 0.0f ? 0.0f : _p.x);
-  _p.y = _p.y > 1.0f ? 1.0f : (_p.y < 0.0f ? 0.0f : _p.y);
-  _p.z = _p.z > 1.0f ? 1.0f : (_p.z < 0.0f ? 0.0f : _p.z);
-}
-
-inline cvec3f computeLightingHost(const cvec3f& _mynor, cvec3f& _lightvec, cvec3f& _matcol)
-{
-  cvec3f out;
-  float _diffuse = 
-  _mynor.x * _lightvec.x + _mynor.y * _lightvec.y + _mynor.z * _lightvec.z; 
-  _diffuse = _diffuse < 0.0f ? 0.0f : (_diffuse );
-  out.x = (_diffuse * _matcol.x + 0.15f); 
-  out.y = (_diffuse * _matcol.y + 0.15f); 
-  out.z = (_diffuse * _matcol.z + 0.30f); 
-  saturatePixelHost(out);
-  return out;
-}
-
-inline unsigned toABGRHost(cvec3f color)
-{
-  //printf("r = %f\n", color.x);
-  return ((255<<24) | ((unsigned)(color.z*255.0f)<<16) | ((unsigned)(color.y*255.0f)<<8) | (unsigned)(color.x*255.0f));
-}
-
 void loadTriangleBuffer(int start, int end)
 {
 
@@ -350,69 +735,239 @@ void loadTriangleBuffer(int start, int end)
 
   if (size <=0) return;
 
-  int counter = 0;
-  for(int i=start; i<end; i++)
-  {
-    int t0 = sMain._flatTriangles[i].x;
-    int t1 = sMain._flatTriangles[i].y;
-    int t2 = sMain._flatTriangles[i].z;
-    triangleBuffer[counter].worldPos0 = gencvec3f(sMain._flattVertices[t0].x, sMain._flattVertices[t0].y, sMain._flattVertices[t0].z);
-    triangleBuffer[counter].worldPos1 = gencvec3f(sMain._flattVertices[t1].x, sMain._flattVertices[t1].y, sMain._flattVertices[t1].z);
-    triangleBuffer[counter].worldPos2 = gencvec3f(sMain._flattVertices[t2].x, sMain._flattVertices[t2].y, sMain._flattVertices[t2].z);
-
-    sMain._flattNormals[t0] = HOST::normalize(sMain._flattNormals[t0]);
-    sMain._flattNormals[t1] = HOST::normalize(sMain._flattNormals[t1]);
-    sMain._flattNormals[t2] = HOST::normalize(sMain._flattNormals[t2]);
+  // every vertex is normalized (and transformed and lit) once, rather than
+  // once for every triangle that uses it, see hostPretransform.h
+  int numVertices = sMain._flatnVertices;
+  cvec3f* normals = sMain._flattNormals;
 
 #ifdef VTX_PRETRANSFORM
-    cvec3f lightvec0 = (sMain.cam().eye() - triangleBuffer[counter].worldPos0);
-    cvec3f lightvec1 = (sMain.cam().eye() - triangleBuffer[counter].worldPos1);
-    cvec3f lightvec2 = (sMain.cam().eye() - triangleBuffer[counter].worldPos2);
-
-    normalizeInplace(lightvec0);
-    normalizeInplace(lightvec1);
-    normalizeInplace(lightvec2);
-
-    inPlaceTransform(triangleBuffer[counter].worldPos0, pipelineConstantState.viewProjMatrix);
-    inPlaceTransform(triangleBuffer[counter].worldPos1, pipelineConstantState.viewProjMatrix);
-    inPlaceTransform(triangleBuffer[counter].worldPos2, pipelineConstantState.viewProjMatrix);
-
-    cvec3f matcol   = gencvec3f(0.9000f, 0.9000f, 0.6000f);
-    cvec3f lightvec = gencvec3f(0.5773f, 0.5773f, 0.5773f);
+  static vector<cvec3f>   screenPos;
+  static vector<unsigned> colors;
+  screenPos.resize(numVertices);
+  colors.resize(numVertices);
+
+  hostPretransformParams prm;
+  prm.viewProjMatrix = pipelineConstantState.viewProjMatrix;
+  prm.halfW = pipelineConstantState.halfW;
+  prm.halfH = pipelineConstantState.halfH;
+  prm.eye   = sMain.cam().eye();
+
+  const cvec3f* vertices = sMain._flattVertices;
+  hostParallelFor(numVertices, [&](int begin, int end) {
+    pretransformVertices(prm, vertices, normals, begin, end, &screenPos[0], &colors[0]);
+  });
+#else
+  hostParallelFor(numVertices, [&](int begin, int end) {
+    for(int v = begin; v < end; v++)
+      normals[v] = HOST::normalize(normals[v]);
+  });
+#endif
 
+  hostParallelFor(size, [&](int begin, int end) {
+    for(int counter = begin; counter < end; counter++)
+    {
+      int i  = start + counter;
+      int t0 = sMain._flatTriangles[i].x;
+      int t1 = sMain._flatTriangles[i].y;
+      int t2 = sMain._flatTriangles[i].z;
 
-    triangleBuffer[counter].icol0 = toABGRHost(computeLightingHost(sMain._flattNormals[t0], lightvec0, matcol));
-    triangleBuffer[counter].icol1 = toABGRHost(computeLightingHost(sMain._flattNormals[t1], lightvec1, matcol));
-    triangleBuffer[counter].icol2 = toABGRHost(computeLightingHost(sMain._flattNormals[t2], lightvec2, matcol));
+#ifdef VTX_PRETRANSFORM
+      triangleBuffer[counter].worldPos0 = screenPos[t0];
+      triangleBuffer[counter].worldPos1 = screenPos[t1];
+      triangleBuffer[counter].worldPos2 = screenPos[t2];
+      triangleBuffer[counter].icol0 = colors[t0];
+      triangleBuffer[counter].icol1 = colors[t1];
+      triangleBuffer[counter].icol2 = colors[t2];
 #else
-    triangleBuffer[counter].normal0 = gencvec2f(sMain._flattNormals[t0].x, sMain._flattNormals[t0].y);
-    triangleBuffer[counter].normal1 = gencvec2f(sMain._flattNormals[t1].x, sMain._flattNormals[t1].y);
-    triangleBuffer[counter].normal2 = gencvec2f(sMain._flattNormals[t2].x, sMain._flattNormals[t2].y);
+      triangleBuffer[counter].worldPos0 = sMain._flattVertices[t0];
+      triangleBuffer[counter].worldPos1 = sMain._flattVertices[t1];
+      triangleBuffer[counter].worldPos2 = sMain._flattVertices[t2];
+      triangleBuffer[counter].normal0 = gencvec2f(normals[t0].x, normals[t0].y);
+      triangleBuffer[counter].normal1 = gencvec2f(normals[t1].x, normals[t1].y);
+      triangleBuffer[counter].normal2 = gencvec2f(normals[t2].x, normals[t2].y);
 #endif
-    triangleBuffer[counter].id = counter;
-    counter++;
-  }
-  printf("Added %d triangles\n", counter);
+      triangleBuffer[counter].id = counter;
+    }
+  });
+  printf("Added %d triangles\n", size);
 
   // printf("bounds are %f %f %f to %f %f %f\n",
   //   bbmin.x, bbmin.y, bbmin.z,
   //   bbmax.x, bbmax.y, bbmax.z);
 }
 
+// Packs every vertex of the scene and its first numTriangles triangles into
+// indexedBuffer, record i holding vertex i and triangle i. The pipeline
+// transforms the vertices, so the buffer does not change with the camera.
+void loadIndexedBuffer(int numTriangles)
+{
+  int numVertices = sMain._flatnVertices;
+  nIndexed = max(numVertices, numTriangles);
+
+  delete[] indexedBuffer;
+  indexedBuffer = new raster_ivtx[nIndexed];
+
+  for(int i = 0; i < nIndexed; i++)
+  {
+    raster_ivtx& r = indexedBuffer[i];
+    r.id = i;
+    if(i < numVertices)
+    {
+      r.worldPos = sMain._flattVertices[i];
+      r.normal   = sMain._flattNormals[i];
+    }
+    else
+    {
+      r.worldPos = gencvec3f(0.0f, 0.0f, 0.0f);
+      r.normal   = gencvec3f(0.0f, 0.0f, 1.0f);
+    }
+
+    r.i0 = r.i1 = r.i2 = -1;
+    if(i < numTriangles)
+    {
+      r.i0 = sMain._flatTriangles[i].x;
+      r.i1 = sMain._flatTriangles[i].y;
+      r.i2 = sMain._flatTriangles[i].z;
+    }
+  }
+
+  // MutableState::vertexBuffer holds the transformed vertices on the device
+  pipelineMutableState.numVertices = numVertices;
+  pipelineMutableState.vertexBytes = sizeof(raster_tvtx);
+
+  printf("Added %d vertices and %d triangles\n", numVertices, numTriangles);
+}
+
+// Packs the meshlets of the scene that lie in its first numTriangles
+// triangles into meshletBuffer, and their vertices and triangles into
+// indexedBuffer. Every meshlet gets records of its own, record i holding its
+// vertex i and triangle i, so the vertices it shares with other meshlets are
+// copied into each of them.
+void loadMeshletBuffer(int numTriangles)
+{
+  vector<int> localVertex(sMain._flatnVertices, -1);
+  vector<int> meshletVertices;
+  vector<raster_ivtx> records;
+
+  nMeshlets = 0;
+  while(nMeshlets < sMain._flatnMeshlets
+    && sMain._flatMeshlets[nMeshlets].firstTriangle + sMain._flatMeshlets[nMeshlets].numTriangles <= numTriangles)
+    nMeshlets++;
+
+  delete[] meshletBuffer;
+  meshletBuffer = new raster_meshlet[nMeshlets];
+
+  for(int mi = 0; mi < nMeshlets; mi++)
+  {
+    const meshlet& m = sMain._flatMeshlets[mi];
+    int first = records.size();
+
+    meshletVertices.clear();
+    for(int ti = m.firstTriangle; ti < m.firstTriangle + m.numTriangles; ti++)
+    {
+      int v[3] = {sMain._flatTriangles[ti].x, sMain._flatTriangles[ti].y, sMain._flatTriangles[ti].z};
+      for(int k = 0; k < 3; k++)
+      {
+        if(localVertex[v[k]] < 0)
+        {
+          localVertex[v[k]] = meshletVertices.size();
+          meshletVertices.push_back(v[k]);
+        }
+      }
+    }
+
+    int count = max((int) meshletVertices.size(), m.numTriangles);
+    for(int i = 0; i < count; i++)
+    {
+      // records past the last vertex repeat the first one
+      int vi = meshletVertices[i < (int) meshletVertices.size() ? i : 0];
+
+      raster_ivtx r;
+      r.id       = first + i;
+      r.worldPos = sMain._flattVertices[vi];
+      r.normal   = sMain._flattNormals[vi];
+      r.i0 = r.i1 = r.i2 = -1;
+      if(i < m.numTriangles)
+      {
+        const cvec4i& t = sMain._flatTriangles[m.firstTriangle + i];
+        r.i0 = first + localVertex[t.x];
+        r.i1 = first + localVertex[t.y];
+        r.i2 = first + localVertex[t.z];
+      }
+      records.push_back(r);
+    }
+
+    for(int i = 0; i < (int) meshletVertices.size(); i++)
+      localVertex[meshletVertices[i]] = -1;
+
+    raster_meshlet& r = meshletBuffer[mi];
+    r.id         = mi;
+    r.center     = m.center;
+    r.radius     = m.radius;
+    r.coneAxis   = m.coneAxis;
+    r.coneCutoff = m.coneCutoff;
+    r.first      = first;
+    r.count      = count;
+  }
+
+  nIndexed = records.size();
+  delete[] indexedBuffer;
+  indexedBuffer = new raster_ivtx[nIndexed];
+  for(int i = 0; i < nIndexed; i++)
+    indexedBuffer[i] = records[i];
+
+  // every record has a vertex, and MeshletStage reads the records of the
+  // meshlets it keeps from MutableState::geometryBuffer
+  pipelineMutableState.numVertices    = nIndexed;
+  pipelineMutableState.vertexBytes    = sizeof(raster_tvtx);
+  pipelineMutableState.geometryBuffer = indexedBuffer;
+  pipelineMutableState.geometryBytes  = nIndexed * sizeof(raster_ivtx);
+
+  printf("Added %d meshlets with %d records\n", nMeshlets, nIndexed);
+}
+
 void resetDepthBuffer()
 {
-  int nPixels = pipelineConstantState.screenSizeX * pipelineConstantState.screenSizeY;
+  int nPixels = pikoPixelBufferSize(pipelineConstantState.screenSizeX,
+                                    pipelineConstantState.screenSizeY);
   for(int i = 0; i < nPixels; i++)
   {
     pipelineMutableState.zBuffer[i] = 1.0f;
   }
+
+  // every tile is cleared to depth 1.0f
+  float clearDepth = 1.0f;
+  int clearDepthBits;
+  memcpy(&clearDepthBits, &clearDepth, sizeof(int));
+  int nTiles = ((pipelineConstantState.screenSizeX + PIKO_HIZ_TILE - 1) >> PIKO_HIZ_TILE_LG2)
+             * ((pipelineConstantState.screenSizeY + PIKO_HIZ_TILE - 1) >> PIKO_HIZ_TILE_LG2);
+  for(int i = 0; i < nTiles; i++)
+  {
+    pipelineMutableState.hizBuffer[i] = clearDepthBits;
+  }
+
+  // no triangle is visible anywhere
+  if(pipelineMutableState.visBuffer != NULL)
+  {
+    for(int i = 0; i < nPixels; i++)
+    {
+      pipelineMutableState.visBuffer[i] = -1;
+    }
+  }
 }
 
 void destroyApp()
 {
   piko_pipe.destroy();
+  pikoFreeMutableState(pipelineMutableState);
+  delete[] indexedBuffer;
+  indexedBuffer = NULL;
+  delete[] meshletBuffer;
+  meshletBuffer = NULL;
 }
 
+#ifndef __PIKOC_HEADLESS__
+
 void mouseHandler(int button, int state, int x, int y) {
   if(button == GLUT_LEFT_BUTTON && state == GLUT_DOWN) {
     //onMouse = 1;
@@ -432,4 +987,6 @@ void keypressed(unsigned char key, int x, int y)
   }
 }
 
+#endif // __PIKOC_HEADLESS__
+
 #endif // __PIKOC_HOST__
@@ -62,6 +62,69 @@ inline void computePixelBoundingBoxFixPt(raster_stri& _p, boundingBoxFixPt& _bb)
   _bb.hi.y = RoundUpFixPt   (piko::max_max(_p.y0, _p.y1, _p.y2)); 
 }
 
+// Depth tests compare the float bits of depths as signed ints. These bound
+// the ints of the depths in [lo, hi]; negative depths order backwards
+inline int depthOrderMin(float lo, float hi) {
+  if(lo > 0.0f) return float_as_int(lo);
+  if(hi < 0.0f) return float_as_int(hi);
+  return (int)0x80000000; // -0.0f, below every other depth
+}
+
+inline int depthOrderMax(float lo, float hi) {
+  if(hi > 0.0f) return float_as_int(hi);
+  if(hi < 0.0f) return float_as_int(lo);
+  return 0;
+}
+
+// Bounds of the interpolated depths of the fragments of a triangle, padded
+// for the rounding of alpha/beta and of the interpolation
+inline void computeDepthBoundsFixPt(raster_stri& _p, int& _zLo, int& _zHi) {
+  float zmin = _p.z0 < _p.z1 ? (_p.z0 < _p.z2 ? _p.z0 : _p.z2) : (_p.z1 < _p.z2 ? _p.z1 : _p.z2);
+  float zmax = _p.z0 > _p.z1 ? (_p.z0 > _p.z2 ? _p.z0 : _p.z2) : (_p.z1 > _p.z2 ? _p.z1 : _p.z2);
+  float zabs = piko::fmaxf(zmax, -zmin);
+  float pad  = zabs * (1.0f / (1 << 20)) + 1e-30f;
+  _zLo = depthOrderMin(zmin - pad, zmax + pad);
+  _zHi = depthOrderMax(zmin - pad, zmax + pad);
+}
+
+inline void computeEdgeFixPt(int x0, int y0, int x1, int y1, raster_edge& _e) {
+  _e.dx = x1 - x0;
+  _e.dy = y1 - y0;
+  _e.c  = x0 * _e.dy - y0 * _e.dx;
+}
+
+// edge function at (x, y), wrapping like (y - y0) * dx - (x - x0) * dy
+inline int evalEdgeFixPt(const raster_edge& _e, int x, int y) {
+  return y * _e.dx - x * _e.dy + _e.c;
+}
+
+inline void computeTriangleSetup(raster_stri& _p, raster_setup& _s) {
+  computeEdgeFixPt(_p.x0, _p.y0, _p.x1, _p.y1, _s.edge0);
+  computeEdgeFixPt(_p.x1, _p.y1, _p.x2, _p.y2, _s.edge1);
+  computeEdgeFixPt(_p.x2, _p.y2, _p.x0, _p.y0, _s.edge2);
+  computePixelBoundingBoxFixPt(_p, _s.bb);
+
+  int barydenom = - _s.edge2.dy * _s.edge0.dx + _s.edge2.dx * _s.edge0.dy;
+  _s.onebybary = piko::rcp_approx((float)barydenom);
+
+  _s.z2    = _p.z2;
+  _s.z0mz2 = _p.z0 - _p.z2;
+  _s.z1mz2 = _p.z1 - _p.z2;
+  computeDepthBoundsFixPt(_p, _s.zLo, _s.zHi);
+
+#ifdef GORAUD
+  cvec3f vcol0 = piko::fromABGR(_p.icol0);
+  cvec3f vcol1 = piko::fromABGR(_p.icol1);
+  _s.col2      = piko::fromABGR(_p.icol2);
+  _s.col0mcol2 = vcol0 - _s.col2;
+  _s.col1mcol2 = vcol1 - _s.col2;
+#else
+  _s.normal0 = _p.normal0;
+  _s.normal1 = _p.normal1;
+  _s.normal2 = _p.normal2;
+#endif
+}
+
 inline bool isBBBetweenSamples(boundingBoxFixPt& bb)
 {
   // int bbSizeX = bb.hi.x - bb.lo.x;
@@ -76,6 +139,27 @@ inline bool isBBBetweenSamples(boundingBoxFixPt& bb)
   return false;
 }
 
+// Culls the screen-space triangle _p of a W x H screen, and sets up _s for
+// the rasterizer if it is visible
+inline bool setupVisibleTriangle(raster_stri& _p, float W, float H, raster_setup& _s)
+{
+  float maxZ, minZ;
+
+  // todo: frustum test before transform
+  if(!isFrontFacingFixPt(_p) || !isInsideFrustumFixPt(_p, minZ, maxZ, W*16, H*16))
+    return false;
+
+  boundingBoxFixPt bb;
+  computeBoundingBoxFixPt(_p, bb);
+  if(isBBBetweenSamples(bb))
+    return false;
+
+  // set up the edges, depth plane and attributes once, rather than in every
+  // bin the rasterizer finds the triangle in
+  computeTriangleSetup(_p, _s);
+  return true;
+}
+
 // #define assignToBB(_p, _bb, _binsize) 
 //     int bx1 = (int)piko::floorf(_bb.lo.x / (float)_binsize);  
 //     int bx2 = (int)piko::floorf(_bb.hi.x / (float)_binsize);  
@@ -177,6 +261,47 @@ inline void getSampleIdFromMask(
   y = (lowBit >> 3);
 }
 
+// Hierarchical depth. hizBuffer holds an upper bound of the depths of every
+// PIKO_HIZ_TILE^2 tile of the depth buffer; a triangle whose fragments are
+// all deeper than the bounds of the tiles it overlaps cannot pass any depth
+// test there. Bounds only ever decrease, so a stale read culls less, never
+// more, and concurrent updates only need an atomic minimum.
+
+// largest bound of the on-screen tiles overlapping [lo, hi) (28.4 fixed
+// point); tilesX and tilesY are the tiles of the screen
+inline int hizMaxDepth(int* hiz, int tilesX, int tilesY, cvec2i& lo, cvec2i& hi)
+{
+  int tileBits = 4 + PIKO_HIZ_TILE_LG2;
+  int tyEnd = piko::imin(((hi.y - 1) >> tileBits) + 1, tilesY);
+  int txEnd = piko::imin(((hi.x - 1) >> tileBits) + 1, tilesX);
+  int maxZ = (int)0x80000000;
+  for(int ty = (lo.y >> tileBits); ty < tyEnd; ty++)
+    for(int tx = (lo.x >> tileBits); tx < txEnd; tx++)
+      maxZ = piko::imax(maxZ, hiz[ty * tilesX + tx]);
+  return maxZ;
+}
+
+// lowers the bounds of the tiles entirely inside [lo, hi), which a triangle
+// with fragment depths of at most zHi covers. exclusive when no other thread
+// can update these tiles meanwhile
+inline void hizCover(int* hiz, int tilesX, int tilesY, cvec2i& lo, cvec2i& hi, int zHi,
+  bool exclusive)
+{
+  int tileBits = 4 + PIKO_HIZ_TILE_LG2;
+  int tileMask = (1 << tileBits) - 1;
+  int tyEnd = piko::imin(hi.y >> tileBits, tilesY);
+  int txEnd = piko::imin(hi.x >> tileBits, tilesX);
+  for(int ty = ((lo.y + tileMask) >> tileBits); ty < tyEnd; ty++)
+    for(int tx = ((lo.x + tileMask) >> tileBits); tx < txEnd; tx++)
+    {
+      int* tileZ = &hiz[ty * tilesX + tx];
+      if(exclusive)
+        *tileZ = piko::imin(*tileZ, zHi);
+      else
+        piko::atomicMin(tileZ, zHi);
+    }
+}
+
 #else
 
 #endif
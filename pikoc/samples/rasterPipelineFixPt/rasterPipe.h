@@ -4,21 +4,55 @@
 #include "piko/pipe.h"
 
 #define GORAUD
+
+// Indexed input (pikoc -DRASTER_INDEXED) transforms every vertex once in the
+// pipeline. Otherwise every triangle comes with its three vertices, which
+// the host transforms. Meshlet input (pikoc -DRASTER_MESHLETS) is indexed
+// input that first culls whole meshlets.
+#ifdef RASTER_MESHLETS
+#define RASTER_INDEXED
+#endif
+#ifndef RASTER_INDEXED
 #define VTX_PRETRANSFORM
+#endif
 
 #include "basicTypes/rasterTypes.h"
 #include "piko/helperRoutines.h"
+#ifdef RASTER_MESHLETS
+#include "meshlet.pikostage"
+#include "assembly.pikostage"
+#define RASTER_INPUT_TYPE raster_meshlet
+#elif defined(RASTER_INDEXED)
+#include "assembly.pikostage"
+#define RASTER_INPUT_TYPE raster_ivtx
+#else
 #include "vertexShader.pikostage"
+#define RASTER_INPUT_TYPE raster_wtri
+#endif
 #include "raster.pikostage"
+#ifdef RASTER_DEFERRED
+#include "shade.pikostage"
+#endif
 
 #ifdef __PIKOC_HOST__
 
 class RasterPipe : public PikoPipe
 {
 	// pointer to the scene to render 
+#ifdef RASTER_MESHLETS
+  MeshletStage            meshlet;
+#endif
+#ifdef RASTER_INDEXED
+  VertexStage             vertex;
+  PrimitiveAssemblyStage  assembly;
+#else
   VertexShaderStage vertexShader;
+#endif
 
   RasterStage  raster;
+#ifdef RASTER_DEFERRED
+  ShadeStage   shade;
+#endif
 public:
 
   // host-side
@@ -26,7 +60,7 @@ public:
   MutableState*       mutableState_;
   int         count_;
   PikoScreen  pikoScreen;
-  PikoArray<raster_wtri> h_input;
+  PikoArray<RASTER_INPUT_TYPE> h_input;
 
 #ifdef __PIKO_DEVICE_MEMBERS__
   __PIKO_DEVICE_MEMBERS__
@@ -34,11 +68,22 @@ public:
 
 	RasterPipe()
   {
+#ifdef RASTER_MESHLETS
+		pikoConnect(meshlet, vertex, 0, 0);
+#endif
+#ifdef RASTER_INDEXED
+		pikoConnect(vertex, assembly, 0, 0);
+		pikoConnect(assembly, raster, 0, 0);
+#else
 		pikoConnect(vertexShader, raster, 0, 0);
+#endif
+#ifdef RASTER_DEFERRED
+		pikoConnect(raster, shade, 0, 0);
+#endif
 	}
 
-  void run        (ConstantState& constState, MutableState& mutableState, raster_wtri* input, int count);
-  void allocate   (ConstantState& constState, MutableState& mutableState, raster_wtri* input, int count);
+  void run        (ConstantState& constState, MutableState& mutableState, RASTER_INPUT_TYPE* input, int count);
+  void allocate   (ConstantState& constState, MutableState& mutableState, RASTER_INPUT_TYPE* input, int count);
   void prepare    ();
   void run_single ();
   void destroy    ();
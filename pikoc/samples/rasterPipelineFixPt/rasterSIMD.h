@@ -0,0 +1,216 @@
+#ifndef RASTER_SIMD_H
+#define RASTER_SIMD_H
+
+// AVX2 coverage and shading of one 8x8 bin of RasterStage on the CPU target.
+// A row of the bin is one 8-lane vector, so a triangle is rasterized with
+// eight edge-function vectors per edge instead of 64 scalar evaluations.
+//
+// The results are bit-identical to the scalar path: edge functions are the
+// same 32-bit integer sums (wrapping the same way), alpha/beta/z and colors
+// use the same single-precision operations in the same order without FMA,
+// and the depth test compares the float bits as signed integers like
+// piko::atomicMin.
+//
+// Selected when the device code is compiled for AVX2 (pikoc --mattr=+avx2 or
+// an AVX2 host CPU, or -mavx2 for the host compile of -O0 builds) with 8x8
+// bins that one thread processes at a time, as the depth buffer is updated
+// without atomics. Define RASTER_NO_SIMD to keep the scalar path.
+
+#if defined(__PIKOC_DEVICE__) && defined(__PIKOC_CPU__) && defined(__AVX2__) \
+  && (RASTER_BINSIZE_LG2 == 3) && PIKO_EXCLUSIVE_BINS(RasterStage) && !defined(RASTER_NO_SIMD)
+
+#define RASTER_SIMD
+
+#include <immintrin.h>
+
+// step * (0, 1, ..., 7)
+inline __m256i rasterLaneSteps(int step)
+{
+  return _mm256_mullo_epi32(_mm256_set1_epi32(step),
+    _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+}
+
+// all ones in the lanes whose bit is set in bits
+inline __m256i rasterLaneMask(unsigned bits)
+{
+  __m256i laneBits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+  return _mm256_cmpeq_epi32(
+    _mm256_and_si256(_mm256_set1_epi32(bits), laneBits), laneBits);
+}
+
+// bits of columns [colBeg, colEnd)
+inline unsigned rasterColumnMask(int colBeg, int colEnd)
+{
+  if(colEnd <= colBeg)
+    return 0;
+  return ((1u << colEnd) - 1) & ~((1u << colBeg) - 1);
+}
+
+// Sample mask of rows [rowBeg, rowEnd) and the columns of colMask, bit
+// row * 8 + col. e0..e2 are the edge functions at the first sample of the
+// bin; a sample is covered when none of them is negative.
+inline unsigned long long rasterCoverage8x8(
+  int e0, int e1, int e2,
+  int step0x, int step1x, int step2x,
+  int step0y, int step1y, int step2y,
+  int rowBeg, int rowEnd, unsigned colMask)
+{
+  unsigned long long sampleMask = 0ull;
+  if(colMask == 0)
+    return sampleMask;
+
+  __m256i lane0 = rasterLaneSteps(step0x);
+  __m256i lane1 = rasterLaneSteps(step1x);
+  __m256i lane2 = rasterLaneSteps(step2x);
+
+  for(int row = rowBeg; row < rowEnd; row++)
+  {
+    __m256i e0v = _mm256_add_epi32(_mm256_set1_epi32(e0 + row * step0y), lane0);
+    __m256i e1v = _mm256_add_epi32(_mm256_set1_epi32(e1 + row * step1y), lane1);
+    __m256i e2v = _mm256_add_epi32(_mm256_set1_epi32(e2 + row * step2y), lane2);
+
+    // the sign bit of the OR is set when any edge function is negative
+    __m256i anyNeg = _mm256_or_si256(_mm256_or_si256(e0v, e1v), e2v);
+    unsigned outside = _mm256_movemask_ps(_mm256_castsi256_ps(anyNeg));
+
+    sampleMask |= (unsigned long long)(~outside & colMask) << (row * 8);
+  }
+  return sampleMask;
+}
+
+// Fragments of one bin that passed the depth test, by sample
+struct rasterFragments8x8
+{
+  unsigned long long mask;
+  float alpha[64];
+  float beta[64];
+#ifdef GORAUD
+  unsigned color[64];
+#endif
+};
+
+// Interpolates depth of the samples of sampleMask, tests and updates their
+// depth in zBuffer, which points at the first sample of the bin in a buffer
+// whose rows are pitch apart (see pixelRowPitch()), and interpolates the
+// barycentrics (and colors) of the samples that passed. e1 and e2 are the
+// edge functions opposite vertices 0 and 1 at the first sample of the bin.
+inline void rasterShade8x8(
+  unsigned long long sampleMask, int e1, int e2,
+  int step1x, int step2x, int step1y, int step2y,
+  float onebybary, float z0mz2, float z1mz2, float z2,
+  int* zBuffer, int pitch,
+#ifdef GORAUD
+  const cvec3f& dcol0mcol2, const cvec3f& dcol1mcol2, const cvec3f& vcol2,
+#endif
+  rasterFragments8x8& frags)
+{
+  frags.mask = 0ull;
+
+  __m256i lane1 = rasterLaneSteps(step1x);
+  __m256i lane2 = rasterLaneSteps(step2x);
+  __m256 rcp = _mm256_set1_ps(onebybary);
+
+  for(int row = 0; row < 8; row++)
+  {
+    unsigned rowMask = (unsigned)(sampleMask >> (row * 8)) & 0xff;
+    if(rowMask == 0)
+      continue;
+
+    __m256i e1v = _mm256_add_epi32(_mm256_set1_epi32(e1 + row * step1y), lane1);
+    __m256i e2v = _mm256_add_epi32(_mm256_set1_epi32(e2 + row * step2y), lane2);
+
+    __m256 alpha = _mm256_mul_ps(_mm256_cvtepi32_ps(e1v), rcp);
+    __m256 beta  = _mm256_mul_ps(_mm256_cvtepi32_ps(e2v), rcp);
+
+    // interpolate_alphabeta(): f2 + alpha * f0mf2 + beta * f1mf2
+    __m256 z = _mm256_add_ps(
+      _mm256_add_ps(_mm256_set1_ps(z2), _mm256_mul_ps(alpha, _mm256_set1_ps(z0mz2))),
+      _mm256_mul_ps(beta, _mm256_set1_ps(z1mz2)));
+    __m256i zi = _mm256_castps_si256(z);
+
+    // depth test: pass where z <= the stored depth, keep the minimum
+    int* zRow = zBuffer + row * pitch;
+    __m256i covered = rasterLaneMask(rowMask);
+    __m256i oldZi = _mm256_maskload_epi32(zRow, covered);
+    __m256i passed = _mm256_andnot_si256(_mm256_cmpgt_epi32(zi, oldZi), covered);
+    _mm256_maskstore_epi32(zRow, covered, _mm256_min_epi32(oldZi, zi));
+
+    unsigned passMask = _mm256_movemask_ps(_mm256_castsi256_ps(passed));
+    if(passMask == 0)
+      continue;
+    frags.mask |= (unsigned long long) passMask << (row * 8);
+
+    _mm256_storeu_ps(&frags.alpha[row * 8], alpha);
+    _mm256_storeu_ps(&frags.beta[row * 8], beta);
+
+#ifdef GORAUD
+    // piko::toABGR() of the interpolated color
+    __m256 s255 = _mm256_set1_ps(255.0f);
+    __m256 cx = _mm256_add_ps(
+      _mm256_add_ps(_mm256_set1_ps(vcol2.x), _mm256_mul_ps(alpha, _mm256_set1_ps(dcol0mcol2.x))),
+      _mm256_mul_ps(beta, _mm256_set1_ps(dcol1mcol2.x)));
+    __m256 cy = _mm256_add_ps(
+      _mm256_add_ps(_mm256_set1_ps(vcol2.y), _mm256_mul_ps(alpha, _mm256_set1_ps(dcol0mcol2.y))),
+      _mm256_mul_ps(beta, _mm256_set1_ps(dcol1mcol2.y)));
+    __m256 cz = _mm256_add_ps(
+      _mm256_add_ps(_mm256_set1_ps(vcol2.z), _mm256_mul_ps(alpha, _mm256_set1_ps(dcol0mcol2.z))),
+      _mm256_mul_ps(beta, _mm256_set1_ps(dcol1mcol2.z)));
+
+    __m256i ix = _mm256_cvttps_epi32(_mm256_mul_ps(cx, s255));
+    __m256i iy = _mm256_cvttps_epi32(_mm256_mul_ps(cy, s255));
+    __m256i iz = _mm256_cvttps_epi32(_mm256_mul_ps(cz, s255));
+
+    __m256i color = _mm256_or_si256(_mm256_set1_epi32(255 << 24),
+      _mm256_or_si256(_mm256_slli_epi32(iz, 16),
+        _mm256_or_si256(_mm256_slli_epi32(iy, 8), ix)));
+    _mm256_storeu_si256((__m256i*) &frags.color[row * 8], color);
+#endif
+  }
+}
+
+// Like rasterShade8x8() without interpolating attributes, for RASTER_DEFERRED.
+// Returns the samples of sampleMask that passed the depth test.
+inline unsigned long long rasterDepth8x8(
+  unsigned long long sampleMask, int e1, int e2,
+  int step1x, int step2x, int step1y, int step2y,
+  float onebybary, float z0mz2, float z1mz2, float z2,
+  int* zBuffer, int pitch)
+{
+  unsigned long long passMask = 0ull;
+
+  __m256i lane1 = rasterLaneSteps(step1x);
+  __m256i lane2 = rasterLaneSteps(step2x);
+  __m256 rcp = _mm256_set1_ps(onebybary);
+
+  for(int row = 0; row < 8; row++)
+  {
+    unsigned rowMask = (unsigned)(sampleMask >> (row * 8)) & 0xff;
+    if(rowMask == 0)
+      continue;
+
+    __m256i e1v = _mm256_add_epi32(_mm256_set1_epi32(e1 + row * step1y), lane1);
+    __m256i e2v = _mm256_add_epi32(_mm256_set1_epi32(e2 + row * step2y), lane2);
+
+    __m256 alpha = _mm256_mul_ps(_mm256_cvtepi32_ps(e1v), rcp);
+    __m256 beta  = _mm256_mul_ps(_mm256_cvtepi32_ps(e2v), rcp);
+
+    __m256 z = _mm256_add_ps(
+      _mm256_add_ps(_mm256_set1_ps(z2), _mm256_mul_ps(alpha, _mm256_set1_ps(z0mz2))),
+      _mm256_mul_ps(beta, _mm256_set1_ps(z1mz2)));
+    __m256i zi = _mm256_castps_si256(z);
+
+    int* zRow = zBuffer + row * pitch;
+    __m256i covered = rasterLaneMask(rowMask);
+    __m256i oldZi = _mm256_maskload_epi32(zRow, covered);
+    __m256i passed = _mm256_andnot_si256(_mm256_cmpgt_epi32(zi, oldZi), covered);
+    _mm256_maskstore_epi32(zRow, covered, _mm256_min_epi32(oldZi, zi));
+
+    unsigned rowPassed = _mm256_movemask_ps(_mm256_castsi256_ps(passed));
+    passMask |= (unsigned long long) rowPassed << (row * 8);
+  }
+  return passMask;
+}
+
+#endif // __PIKOC_DEVICE__ && __PIKOC_CPU__ && __AVX2__ && exclusive 8x8 bins
+
+#endif // RASTER_SIMD_H
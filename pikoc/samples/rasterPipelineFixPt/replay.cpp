@@ -0,0 +1,113 @@
+// Replays a frame captured with 'bin/pikobench --capture=file': the states and
+// input triangles are mapped from the capture file, so no scene is parsed and
+// no assets are loaded. Built from the same pipeline as pikobench
+// (pikoc --headless --bench --capture), see README.
+
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+
+#include "rasterPipe.h"
+#include "__pikoCompiledPipe.h"
+
+#ifdef __PIKOC_HOST__
+
+#include "frameWriter.h"
+
+using namespace std;
+
+RasterPipe piko_pipe;
+
+int main(int argc, char* argv[])
+{
+  int warmupFrames = 10;
+  int measuredFrames = 100;
+  const char* jsonFile = "pikoreplay.json";
+  const char* imageFile = NULL;
+  const char* captureFile = NULL;
+
+  for(int i = 1; i < argc; i++)
+  {
+    string arg = argv[i];
+    if(arg.substr(0, 9) == "--warmup=")
+      warmupFrames = atoi(arg.substr(9).c_str());
+    else if(arg.substr(0, 9) == "--frames=")
+      measuredFrames = atoi(arg.substr(9).c_str());
+    else if(arg.substr(0, 7) == "--json=")
+      jsonFile = argv[i] + 7;
+    else if(arg.substr(0, 8) == "--image=")
+      imageFile = argv[i] + 8;
+    else if(arg.substr(0, 1) != "-" && captureFile == NULL)
+      captureFile = argv[i];
+    else
+    {
+      captureFile = NULL;
+      break;
+    }
+  }
+
+  if(captureFile == NULL || measuredFrames <= 0)
+  {
+    printf("Usage: %s [--warmup=N] [--frames=N] [--json=out.json] [--image=frame.bmp]\n"
+           "          frame.cap\n", argv[0]);
+    return 1;
+  }
+
+  PikoCapture capture;
+  if(!capture.open<ConstantState, MutableState, RASTER_INPUT_TYPE>(captureFile))
+    return 1;
+
+  ConstantState& constState = *capture.constState<ConstantState>();
+  MutableState& mutableState = *capture.mutableState<MutableState>();
+
+  printf("Replaying %s: %d triangles, %d warm-up and %d measured frames\n",
+      captureFile, capture.getCount(), warmupFrames, measuredFrames);
+
+  // prepare() copies the captured MutableState again before every frame, so
+  // all frames start from the same depth buffer
+  piko_pipe.allocate(constState, mutableState, capture.input<RASTER_INPUT_TYPE>(), capture.getCount());
+
+  for(int frame = 0; frame < warmupFrames + measuredFrames; frame++)
+  {
+    if(frame == warmupFrames)
+      pikoBench.discard();
+
+    pikoBench.beginFrame();
+    piko_pipe.prepare();
+    piko_pipe.run_single();
+    pikoBench.endFrame();
+  }
+
+  pikoBench.print();
+
+  FILE* json = fopen(jsonFile, "w");
+  if(!json)
+  {
+    printf("Unable to write replay results %s\n", jsonFile);
+    return 1;
+  }
+  stringstream info;
+  info << "\"capture\": \"" << captureFile << "\", "
+       << "\"width\": " << constState.screenSizeX << ", \"height\": " << constState.screenSizeY << ", "
+       << "\"triangles\": " << capture.getCount() << ", \"warmup\": " << warmupFrames;
+  pikoBench.writeJSON(json, "RasterPipe", info.str());
+  fprintf(json, "\n");
+  fclose(json);
+  printf("Wrote replay results to %s\n", jsonFile);
+
+  if(imageFile != NULL)
+  {
+    int W = constState.screenSizeX;
+    int H = constState.screenSizeY;
+    unsigned* data = new unsigned[W * H];
+    piko_pipe.pikoScreen.readPixels(data);
+    writeFrameBMP(imageFile, data, W, H);
+    delete[] data;
+  }
+
+  piko_pipe.destroy();
+  return 0;
+}
+
+#endif // __PIKOC_HOST__
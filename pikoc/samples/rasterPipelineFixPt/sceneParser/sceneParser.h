@@ -8,7 +8,7 @@
 #include <list>
 #include <map>
 #include <float.h>
-#include <GL/glut.h>
+#include "hostMatrix.h"
 
 #include "scene.h"
 
@@ -25,6 +25,7 @@ private:
     scene*          curScene;
     material        curMat;
     map<string,int> curAttrs;
+    float           curXform[16];   // current modelview transform
     
 
     bool fetchLine();
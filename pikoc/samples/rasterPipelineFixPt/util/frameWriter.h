@@ -0,0 +1,42 @@
+/*
+frameWriter.h
+
+saves a frame read back from PikoScreen as a BMP file, for pipelines
+built with pikoc --headless
+*/
+
+#ifndef FRAME_WRITER_H_
+#define FRAME_WRITER_H_
+
+#include <cstdio>
+
+#include "EasyBMP.h"
+
+// pixels are packed as 0xAABBGGRR, bottom row first
+inline bool writeFrameBMP(const char* filename, const unsigned* pixels, int W, int H)
+{
+  BMP img;
+  img.SetSize(W, H);
+  img.SetBitDepth(24);
+
+  for(int y = 0; y < H; y++) {
+    for(int x = 0; x < W; x++) {
+      unsigned p = pixels[(H - 1 - y) * W + x];
+      RGBApixel* out = img(x, y);
+      out->Red   = (p      ) & 0xff;
+      out->Green = (p >>  8) & 0xff;
+      out->Blue  = (p >> 16) & 0xff;
+      out->Alpha = 0;
+    }
+  }
+
+  if(!img.WriteToFile(filename)) {
+    printf("Unable to write %s\n", filename);
+    return false;
+  }
+
+  printf("Wrote frame to %s\n", filename);
+  return true;
+}
+
+#endif // FRAME_WRITER_H_
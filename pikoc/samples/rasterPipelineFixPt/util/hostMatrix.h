@@ -0,0 +1,111 @@
+/*
+hostMatrix.h
+
+column-major 4x4 matrix helpers that follow the OpenGL/GLU conventions
+(glTranslatef, glRotatef, glScalef, gluPerspective, gluLookAt), so that
+scenes and cameras can be set up without a GL context
+*/
+
+#ifndef HOST_MATRIX_H_
+#define HOST_MATRIX_H_
+
+#include <math.h>
+#include <string.h>
+
+inline void hostMatIdentity(float m[16])
+{
+  for(int i=0; i<16; i++)
+    m[i] = (i % 5 == 0) ? 1.0f : 0.0f;
+}
+
+// m = m * n, like glMultMatrixf
+inline void hostMatMult(float m[16], const float n[16])
+{
+  float out[16];
+  for(int c=0; c<4; c++){
+    for(int r=0; r<4; r++){
+      out[c*4+r] = m[0*4+r] * n[c*4+0] + m[1*4+r] * n[c*4+1]
+                 + m[2*4+r] * n[c*4+2] + m[3*4+r] * n[c*4+3];
+    }
+  }
+  memcpy(m, out, 16*sizeof(float));
+}
+
+inline void hostMatTranslate(float m[16], float x, float y, float z)
+{
+  float t[16];
+  hostMatIdentity(t);
+  t[12] = x;
+  t[13] = y;
+  t[14] = z;
+  hostMatMult(m, t);
+}
+
+inline void hostMatScale(float m[16], float x, float y, float z)
+{
+  float s[16];
+  hostMatIdentity(s);
+  s[0]  = x;
+  s[5]  = y;
+  s[10] = z;
+  hostMatMult(m, s);
+}
+
+inline void hostMatRotate(float m[16], float angleDeg, float x, float y, float z)
+{
+  float len = sqrtf(x*x + y*y + z*z);
+  if(len == 0.0f) return;
+  x /= len; y /= len; z /= len;
+
+  float a = angleDeg * (float)M_PI / 180.0f;
+  float c = cosf(a);
+  float s = sinf(a);
+  float t = 1.0f - c;
+
+  float r[16];
+  hostMatIdentity(r);
+  r[0] = x*x*t + c;    r[4] = x*y*t - z*s;  r[8]  = x*z*t + y*s;
+  r[1] = y*x*t + z*s;  r[5] = y*y*t + c;    r[9]  = y*z*t - x*s;
+  r[2] = x*z*t - y*s;  r[6] = y*z*t + x*s;  r[10] = z*z*t + c;
+  hostMatMult(m, r);
+}
+
+inline void hostMatPerspective(float m[16], float fovyDeg, float aspect, float zNear, float zFar)
+{
+  float f = 1.0f / tanf(fovyDeg * (float)M_PI / 360.0f);
+
+  float p[16];
+  memset(p, 0, 16*sizeof(float));
+  p[0]  = f / aspect;
+  p[5]  = f;
+  p[10] = (zFar + zNear) / (zNear - zFar);
+  p[11] = -1.0f;
+  p[14] = (2.0f * zFar * zNear) / (zNear - zFar);
+  hostMatMult(m, p);
+}
+
+inline void hostMatLookAt(float m[16],
+  float eyeX, float eyeY, float eyeZ,
+  float centerX, float centerY, float centerZ,
+  float upX, float upY, float upZ)
+{
+  float f[3] = { centerX - eyeX, centerY - eyeY, centerZ - eyeZ };
+  float flen = sqrtf(f[0]*f[0] + f[1]*f[1] + f[2]*f[2]);
+  f[0] /= flen; f[1] /= flen; f[2] /= flen;
+
+  // s = f x up, u = s x f
+  float s[3] = { f[1]*upZ - f[2]*upY, f[2]*upX - f[0]*upZ, f[0]*upY - f[1]*upX };
+  float slen = sqrtf(s[0]*s[0] + s[1]*s[1] + s[2]*s[2]);
+  s[0] /= slen; s[1] /= slen; s[2] /= slen;
+  float u[3] = { s[1]*f[2] - s[2]*f[1], s[2]*f[0] - s[0]*f[2], s[0]*f[1] - s[1]*f[0] };
+
+  float l[16];
+  hostMatIdentity(l);
+  l[0] =  s[0]; l[4] =  s[1]; l[8]  =  s[2];
+  l[1] =  u[0]; l[5] =  u[1]; l[9]  =  u[2];
+  l[2] = -f[0]; l[6] = -f[1]; l[10] = -f[2];
+  hostMatMult(m, l);
+  hostMatTranslate(m, -eyeX, -eyeY, -eyeZ);
+}
+
+#endif // HOST_MATRIX_H_
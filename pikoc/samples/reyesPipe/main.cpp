@@ -11,10 +11,17 @@
 
 #ifdef __PIKOC_HOST__
 
+// headless builds (pikoc --headless) write the frame to a file instead of
+// opening a GLUT window
+#ifdef __PIKOC_HEADLESS__
+#include "frameWriter.h"
+#else
 #include <GL/glut.h>
+#endif // __PIKOC_HEADLESS__
 
 #include <piko/builtinTypes.h>
 #include "host_math.h"
+#include "hostMatrix.h"
 #include "pikoTypes.h"
 #include "FPSMeter.h"
 
@@ -35,7 +42,11 @@ void init(int argc, char* argv[]);
 void initScreen(int W, int H);
 void initScene();
 void initPipe();
+#ifdef __PIKOC_HEADLESS__
+void writeFrame(const char* filename);
+#else
 void display();
+#endif // __PIKOC_HEADLESS__
 void destroyApp();
 void doPerfTest(int n_runs = 10);
 void runPipe();
@@ -78,6 +89,18 @@ int numPatches;
 
 int main(int argc, char* argv[])
 {
+#ifdef __PIKOC_HEADLESS__
+  initScreen(1024, 768);
+  initScene();
+  initPipe();
+  // doPerfTest(100);
+  writeFrame("reyes.bmp");
+#ifdef __PIKOC_INSTRUMENT__
+  piko_pipe.getStats().print();
+#endif // __PIKOC_INSTRUMENT__
+  destroyApp();
+  return 0;
+#else
   glutInit(&argc, argv);
   initScreen(1024, 768);
   initScene();
@@ -86,6 +109,7 @@ int main(int argc, char* argv[])
   // doPerfTest(100);
   atexit(destroyApp);
   glutMainLoop();
+#endif // __PIKOC_HEADLESS__
 }
 
 cvec4f matmultfloat4(float * mvpMat, cvec4f v)
@@ -108,12 +132,34 @@ void initScreen(int W, int H){
   pipelineConstantState.screenSizeX = W;
   pipelineConstantState.screenSizeY = H;
 
+#ifndef __PIKOC_HEADLESS__
   glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGBA | GLUT_DEPTH);
   glutInitWindowSize(W,H);
   glutCreateWindow("Reyes Pipeline");
   glClearColor(0.0f, 0.0f, 0.2f, 1.0f);
+#endif // __PIKOC_HEADLESS__
+}
+
+
+#ifdef __PIKOC_HEADLESS__
+
+void writeFrame(const char* filename)
+{
+  buildProjectionMatrix();
+  resetDepthBuffer();
+
+  piko_pipe.prepare();
+  piko_pipe.run_single();
+
+  int W = pipelineConstantState.screenSizeX;
+  int H = pipelineConstantState.screenSizeY;
+  unsigned* data = new unsigned[W * H];
+  piko_pipe.pikoScreen.readPixels(data);
+  writeFrameBMP(filename, data, W, H);
+  delete[] data;
 }
 
+#else
 
 void display()
 {
@@ -139,6 +185,8 @@ void display()
   // }
 }
 
+#endif // __PIKOC_HEADLESS__
+
 void doPerfTest(int n_runs)
 {
   printf("Running perf test...\n");
@@ -221,6 +269,7 @@ void initPipe()
 
   int numLoadPatches = numPatches;
   loadPatchBuffer(0,numLoadPatches);
+  pikoAllocateMutableState(pipelineMutableState, pipelineConstantState, 1 << PIKO_BUF_VIS);
   resetDepthBuffer();
   piko_pipe.allocate(pipelineConstantState, pipelineMutableState, patchBuffer, numLoadPatches);
 }
@@ -236,22 +285,20 @@ void initPipe()
 void buildProjectionMatrix()
 {
   camera& cam = sMain.cam();
-  glMatrixMode(GL_PROJECTION);
 
-  glLoadIdentity();
-  gluPerspective(cam.fovyDeg(), cam.aspect(), cam.zNear(), cam.zFar());
-  glMatrixMode(GL_MODELVIEW);  glLoadIdentity();
-  gluLookAt(
+  // same matrices as gluPerspective and gluLookAt, without needing a GL context
+  float projMatrix[16];
+  hostMatIdentity(projMatrix);
+  hostMatPerspective(projMatrix, cam.fovyDeg(), cam.aspect(), cam.zNear(), cam.zFar());
+
+  hostMatIdentity(pipelineConstantState.viewMatrix);
+  hostMatLookAt(pipelineConstantState.viewMatrix,
       cam.eye().x,    cam.eye().y,    cam.eye().z,
       cam.target().x, cam.target().y, cam.target().z,
       cam.up().x,     cam.up().y,     cam.up().z);
 
-  glMatrixMode(GL_PROJECTION);
-  glPushMatrix();
-  glGetFloatv(GL_MODELVIEW_MATRIX, pipelineConstantState.viewMatrix);
-  glMultMatrixf(pipelineConstantState.viewMatrix);
-  glGetFloatv(GL_PROJECTION_MATRIX, pipelineConstantState.viewProjMatrix);
-  glPopMatrix();
+  memcpy(pipelineConstantState.viewProjMatrix, projMatrix, 16*sizeof(float));
+  hostMatMult(pipelineConstantState.viewProjMatrix, pipelineConstantState.viewMatrix);
 
   // printf("final projection matrix:\n");
   // for(int i=0; i<16; i++) {
@@ -322,22 +369,28 @@ void pipelineTest()
 }
 
 void resetDepthBuffer() {
-  int nPixels = pipelineConstantState.screenSizeX * pipelineConstantState.screenSizeY;
+  int nPixels = pikoPixelBufferSize(pipelineConstantState.screenSizeX,
+                                    pipelineConstantState.screenSizeY);
   for(int i = 0; i < nPixels; i++) {
     pipelineMutableState.zBuffer[i] = 1.0f;
   }
 }
 
 void printDepthBuffer() {
-  int nPixels = pipelineConstantState.screenSizeX * pipelineConstantState.screenSizeY;
-  for(int i = 0; i < nPixels; i++) {
-    printf("%f\n", pipelineMutableState.zBuffer[i]);
+  int w = pipelineConstantState.screenSizeX;
+  int h = pipelineConstantState.screenSizeY;
+  float* depth = (float*) malloc(w * h * sizeof(float));
+  pikoLinearizePixels(pipelineMutableState.zBuffer, depth, w, h);
+  for(int i = 0; i < w * h; i++) {
+    printf("%f\n", depth[i]);
   }
+  free(depth);
 }
 
 void destroyApp()
 {
   piko_pipe.destroy();
+  pikoFreeMutableState(pipelineMutableState);
 }
 
 #endif // __PIKOC_HOST__
@@ -284,7 +284,7 @@ bool sceneParser::fetchTranslate(){
     //printf("[translate]\n"); fflush(stdout);
     float tx, ty, tz;
     if( fetch3f(tx, ty, tz) ){
-        glTranslatef(tx, ty, tz);
+        hostMatTranslate(curXform, tx, ty, tz);
         return true;
     }else return false;
 }
@@ -293,7 +293,7 @@ bool sceneParser::fetchRotate(){
     //printf("[rotate]\n"); fflush(stdout);
     float rx, ry, rz, rt;
     if( fetch3f(rx, ry, rz) && fetch1f(rt) ){
-        glRotatef(rt, rx, ry, rz);
+        hostMatRotate(curXform, rt, rx, ry, rz);
         return true;
     }else return false;
 }
@@ -302,7 +302,7 @@ bool sceneParser::fetchScale(){
     //printf("[scale]\n"); fflush(stdout);
     float sx, sy, sz;
     if( fetch3f(sx, sy, sz) ){
-        glScalef(sx,sy,sz);
+        hostMatScale(curXform, sx, sy, sz);
         return true;
     }else return false;
 }
@@ -336,7 +336,7 @@ bool sceneParser::fetchLoadbez()
          //apply current transformation to m
 
          float viewmat[16], invviewmat[16];
-         glGetFloatv(GL_MODELVIEW_MATRIX, viewmat);
+         memcpy(viewmat, curXform, 16*sizeof(float));
          GenerateInverseMatrix4f(invviewmat, viewmat);
 
          m->applyTransformation(viewmat, invviewmat);
@@ -365,7 +365,7 @@ bool sceneParser::fetchLoadmesh(){
          //apply current transformation to m
 
          float viewmat[16], invviewmat[16];
-         glGetFloatv(GL_MODELVIEW_MATRIX, viewmat);
+         memcpy(viewmat, curXform, 16*sizeof(float));
          GenerateInverseMatrix4f(invviewmat, viewmat);
 
          m->applyTransformation(viewmat, invviewmat);
@@ -378,8 +378,7 @@ bool sceneParser::fetchLoadmesh(){
 
 bool sceneParser::fetchReset(){
      //printf("[reset]\n"); fflush(stdout);
-     glMatrixMode(GL_MODELVIEW);
-     glLoadIdentity();
+     hostMatIdentity(curXform);
      return true;
 }
 
@@ -468,13 +467,10 @@ void sceneParser::parseFile(string basepath, string filename, scene* sc)
     curScene = sc;
 
 
-    glMatrixMode(GL_MODELVIEW);
-    glPushMatrix();
-    glLoadIdentity();
+    hostMatIdentity(curXform);
 
     while(fetchCommand());
 
-    glPopMatrix();
     printf("\n");
 }
 
@@ -1,10 +1,18 @@
 #include "Backend/CPUBackend.hpp"
 
+#include "clang/Basic/TargetOptions.h"
+
+#include "llvm/DataLayout.h"
 #include "llvm/Instructions.h"
 #include "llvm/Module.h"
 #include "llvm/TypeBuilder.h"
 #include "llvm/PassManager.h"
+#include "llvm/Support/FormattedStream.h"
+#include "llvm/Support/Host.h"
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/TargetRegistry.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/ToolOutputFile.h"
 #include "llvm/Transforms/IPO/PassManagerBuilder.h"
 #include "llvm/Transforms/IPO.h"
 
@@ -20,6 +28,7 @@ bool CPUBackend::emitDefines(std::ostream& outfile) {
   outfile << "#define __PIKO_DEVICE_MEMBERS__ \\\n";
   outfile << "  StageFloor* d_pikoScreen; \\\n";
   outfile << "  " << psum.mutableState_type << " *d_mutableState; \\\n";
+  outfile << "  PikoDeviceState<" << psum.mutableState_type << "> pikoMutableState; \\\n";
   outfile << "  PikoArray<" << psum.input_type << "> *d_input; \\\n";
 
   for(std::vector<stageSummary>::iterator
@@ -30,14 +39,169 @@ bool CPUBackend::emitDefines(std::ostream& outfile) {
     std::string stgType = ii->fullType;
     outfile << "  " << stgType << " *d_" << stgName << "; \\\n";
   }
+  writeRecorderMembers(outfile);
+  writeCaptureMembers(outfile);
   outfile << "  ;\n\n";
 
+  if(emitObject()) {
+    outfile << "// device code is compiled by pikoc into __pikoCompiledPipe.o,\n";
+    outfile << "// the host compiler only sees its declarations\n";
+    outfile << "#define __PIKOC_CPU_OBJECT__\n";
+    outfile << "#ifdef __PIKOC_HOST__\n";
+    outfile << "  #define __PIKOC_DEVICE_EXTERN__\n";
+    outfile << "#endif // __PIKOC_HOST__\n";
+    outfile << "\n";
+  }
+
   return true;
 }
 
+void CPUBackend::addClangArgs(std::vector<const char*>& args)
+{
+  // clang 3.2 does not know the C++11 thread_local keyword used by the
+  // generated runner; __thread gives the same TLS symbols the host expects
+  args.push_back("-Dthread_local=__thread");
+
+  // Line tables of __pikoCompiledPipe.o, which the #line directives of the
+  // kernels map to the stage sources
+  if(pikocOptions.debugInfo)
+    args.push_back("-g");
+}
+
+void CPUBackend::setTargetOptions(clang::TargetOptions& targetOptions)
+{
+  // clang 3.2 knows the same x86 CPU names as LLVM, except "generic"
+  targetOptions.CPU = targetCPU();
+
+  std::string features = pikocOptions.cpuFeatures;
+  size_t start = 0;
+  while(start < features.size()) {
+    size_t end = features.find(',', start);
+    if(end == std::string::npos)
+      end = features.size();
+    if(end > start)
+      targetOptions.Features.push_back(features.substr(start, end - start));
+    start = end + 1;
+  }
+}
+
+// --march, or the host CPU; empty when the host CPU is not known
+std::string CPUBackend::targetCPU()
+{
+  std::string cpu = pikocOptions.cpuName;
+  if(cpu == "" || cpu == "native")
+    cpu = llvm::sys::getHostCPUName();
+  return (cpu == "generic") ? "" : cpu;
+}
+
+bool CPUBackend::createLLVMModule()
+{
+  if(!emitObject())
+    return true;
+
+  return PikoBackend::createLLVMModule();
+}
+
 bool CPUBackend::optimizeLLVMModule(int optLevel)
 {
-	return true;
+  if(!emitObject())
+    return true;
+
+  // Cross-stage inlining: emit, assignBin and process, and the generated emit
+  // specializations that connect them, are folded into the kernels
+  std::vector<llvm::Function*> inlined = stageFunctions();
+  for(int i = 0; i < inlined.size(); ++i) {
+    llvm::Attributes noInline =
+      llvm::Attributes::get(inlined[i]->getContext(), llvm::Attributes::NoInline);
+    inlined[i]->removeFnAttr(noInline);
+    inlined[i]->addFnAttr(llvm::Attributes::AlwaysInline);
+  }
+
+  // Everything except the kernels and the globals shared with the host code
+  // is private to the object. This also keeps the non-inline API functions
+  // that the host code defines as well from clashing at link time.
+  std::vector<const char*> exportList;
+  exportList.push_back("constState");
+  exportList.push_back("overrideBinID");
+  exportList.push_back("threadIdx_x");
+  exportList.push_back("blockIdx_x");
+  exportList.push_back("blockDim_x");
+
+  std::string kernelPrefix = "kernel";
+  for(llvm::Module::iterator
+      ii = module->begin(), ie = module->end(); ii != ie; ++ii)
+  {
+    if(ii->getName().startswith(kernelPrefix))
+      exportList.push_back(ii->getName().data());
+  }
+
+  llvm::TargetMachine* targetMachine = createTargetMachine();
+  if(!targetMachine)
+    return false;
+
+  llvm::PassManagerBuilder   passBuilder;
+  llvm::PassManager          modPassMgr;
+  llvm::FunctionPassManager  fnPassMgr(module);
+
+  passBuilder.OptLevel = optLevel;
+  passBuilder.LoopVectorize = (optLevel >= 2);
+  passBuilder.Vectorize = (optLevel >= 3);
+
+  if(optLevel > 1)
+    passBuilder.Inliner = llvm::createFunctionInliningPass(optLevel > 2 ? 275 : 225);
+  else
+    passBuilder.Inliner = llvm::createAlwaysInlinerPass();
+
+  fnPassMgr.add(new llvm::DataLayout(*targetMachine->getDataLayout()));
+  modPassMgr.add(new llvm::DataLayout(*targetMachine->getDataLayout()));
+  modPassMgr.add(llvm::createInternalizePass(exportList));
+
+  passBuilder.populateFunctionPassManager(fnPassMgr);
+  passBuilder.populateModulePassManager(modPassMgr);
+  modPassMgr.add(llvm::createGlobalDCEPass());
+
+  fnPassMgr.doInitialization();
+  for(llvm::Module::iterator ii = module->begin(), ie = module->end();
+      ii != ie; ++ii)
+  {
+    fnPassMgr.run(*ii);
+  }
+  fnPassMgr.doFinalization();
+
+  modPassMgr.run(*module);
+
+  delete targetMachine;
+  return true;
+}
+
+llvm::TargetMachine* CPUBackend::createTargetMachine()
+{
+  llvm::InitializeNativeTarget();
+  llvm::InitializeNativeTargetAsmPrinter();
+
+  std::string error;
+  std::string triple = module->getTargetTriple();
+  const llvm::Target* target = llvm::TargetRegistry::lookupTarget(triple, error);
+  if(!target) {
+    llvm::errs() << "Unable to find LLVM target for " << triple << ": " << error << "\n";
+    return NULL;
+  }
+
+  std::string cpu = targetCPU();
+  if(cpu == "")
+    cpu = "generic";
+
+  llvm::CodeGenOpt::Level codeGenOpt;
+  switch(pikocOptions.optLevel) {
+    case 0:  codeGenOpt = llvm::CodeGenOpt::None;       break;
+    case 1:  codeGenOpt = llvm::CodeGenOpt::Less;       break;
+    case 2:  codeGenOpt = llvm::CodeGenOpt::Default;    break;
+    default: codeGenOpt = llvm::CodeGenOpt::Aggressive; break;
+  }
+
+  llvm::TargetOptions targetOptions;
+  return target->createTargetMachine(triple, cpu, pikocOptions.cpuFeatures,
+    targetOptions, llvm::Reloc::Default, llvm::CodeModel::Default, codeGenOpt);
 }
 
 bool CPUBackend::emitRunFunc(std::ostream& outfile)
@@ -46,42 +210,54 @@ bool CPUBackend::emitRunFunc(std::ostream& outfile)
   std::string pipeName = psum.name;
 	bool optimize = pikocOptions.optimize;
 
+  outfile << "#ifndef __PIKOC_DEVICE_EXTERN__\n";
   outfile << "thread_local int threadIdx_x = 0;\n";
   outfile << "thread_local int blockIdx_x = 0;\n";
   outfile << "int blockDim_x = 0;\n";
+  outfile << "#endif // __PIKOC_DEVICE_EXTERN__\n";
   outfile << "\n";
   outfile << "#ifdef __PIKOC_HOST__\n";
   outfile << "#ifndef PIKO_" << pipeName << "_RUNFUNC_H\n";
   outfile << "#define PIKO_" << pipeName << "_RUNFUNC_H\n";
   outfile << "\n";
-  outfile << "#include <GL/glut.h>\n";
-  outfile << "\n";
+  if(!pikocOptions.headless) {
+    outfile << "#include <GL/glut.h>\n";
+    outfile << "\n";
+  }
 
   outfile << "#include <cstdio>\n";
   outfile << "#include <cstring>\n";
-  outfile << "#include <ctime>\n";
+  outfile << "#include \"piko/timer.h\"\n";
+  outfile << "#include \"piko/threads.h\"\n";
   outfile << "#include <thread>\n";
   outfile << "\n";
 
+  writeRecorderDecl(outfile);
+
   outfile << "unsigned* pixelData;\n";
+  outfile << "// worker threads of parallel kernels, read by allocate() and run()\n";
+  outfile << "unsigned pikoNumCPUThreads = pikoGetNumCPUThreads();\n";
   outfile << "\n";
 
-  outfile << "void pikoDisplayFunc() {\n";
-  outfile << "  //glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);\n";
-  outfile << "  glDrawPixels(constState.screenSizeX, constState.screenSizeY,\n";
-  outfile << "    GL_RGBA, GL_UNSIGNED_BYTE, pixelData);\n";
-  outfile << "  glutSwapBuffers();\n";
-  outfile << "}\n";
-  outfile << "\n";
+  // Headless builds leave the last frame in pixelData for the caller
+  if(!pikocOptions.headless) {
+    outfile << "void pikoDisplayFunc() {\n";
+    outfile << "  //glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);\n";
+    outfile << "  glDrawPixels(constState.screenSizeX, constState.screenSizeY,\n";
+    outfile << "    GL_RGBA, GL_UNSIGNED_BYTE, pixelData);\n";
+    outfile << "  glutSwapBuffers();\n";
+    outfile << "}\n";
+    outfile << "\n";
+  }
 
   outfile << "void " << pipeName << "::run("
     << psum.constState_type << " &h_constState, " << psum.mutableState_type << "&h_mutableState, "
     << psum.input_type << " *inputData, int count) {\n";
 
   if(pikocOptions.enableTimers) {
-    outfile << "  clock_t totalTime, setupTime, kernelTime;\n";
-    outfile << "  totalTime = clock();\n";
-    outfile << "  setupTime = clock();\n";
+    outfile << "  double totalTime, setupTime, kernelTime;\n";
+    outfile << "  totalTime = pikoWallTimeMs();\n";
+    outfile << "  setupTime = pikoWallTimeMs();\n";
     outfile << "\n";
   }
 
@@ -89,6 +265,7 @@ bool CPUBackend::emitRunFunc(std::ostream& outfile)
   outfile << "  h_mutableState.isMutableState();\n";
   outfile << "  inputData[0].isPrim();\n";
   outfile << "  constState = h_constState;\n";
+  outfile << "  pikoNumCPUThreads = pikoGetNumCPUThreads();\n";
   outfile << "\n";
   outfile << "// Create a device pointer for each stage\n";
   outfile << "// and map the host pointer to the device pointer\n";
@@ -128,13 +305,14 @@ bool CPUBackend::emitRunFunc(std::ostream& outfile)
   outfile << "  int numBlocks;\n";
   outfile << "  int numThreads;\n";
   outfile << "  " << psum.mutableState_type << " *d_mutableState;\n";
+  outfile << "  PikoDeviceState<" << psum.mutableState_type << "> pikoMutableState;\n";
   outfile << "  PikoArray<" << psum.input_type << "> *d_input;\n";
   outfile << "  PikoArray<" << psum.input_type << "> h_input;\n";
   outfile << "\n";
   outfile << "  h_input.allocate();\n";
   outfile << "  h_input.copyData(inputData, count);\n";
-  outfile << "  d_mutableState = (" << psum.mutableState_type << "*) malloc(sizeof("
-    << psum.mutableState_type << "));\n";
+  outfile << "  pikoMutableState.allocate(h_constState, h_mutableState);\n";
+  outfile << "  d_mutableState = pikoMutableState.get();\n";
   outfile << "  d_input = &h_input;\n";
   outfile << "\n";
 
@@ -159,9 +337,10 @@ bool CPUBackend::emitRunFunc(std::ostream& outfile)
     }
   }
   outfile << "\n";
+  writeRecorderSetup("  ", outfile);
 
   if(pikocOptions.enableTimers) {
-    outfile << "  setupTime = clock() - setupTime;\n";
+    outfile << "  setupTime = pikoWallTimeMs() - setupTime;\n";
     outfile << "\n";
   }
 
@@ -175,7 +354,7 @@ bool CPUBackend::emitRunFunc(std::ostream& outfile)
   outfile << tabs << "{\n";
 	tabs = "    ";
 
-  outfile << tabs << "memcpy(d_mutableState, &h_mutableState, sizeof(" << psum.mutableState_type << "));\n";
+  outfile << tabs << "pikoMutableState.copyFrom(h_mutableState);\n";
   outfile << tabs << "constState = h_constState;\n";
 	outfile << "\n";
   writeKernelCalls(tabs, outfile);
@@ -188,7 +367,7 @@ bool CPUBackend::emitRunFunc(std::ostream& outfile)
   outfile << tabs << "// ------ TIMED RUNS -----\n";
   outfile << tabs << "// -----------------------\n";
   if(pikocOptions.enableTimers) {
-    outfile << tabs << "kernelTime = clock();\n";
+    outfile << tabs << "kernelTime = pikoWallTimeMs();\n";
   }
   // loop starts here
   outfile << tabs << "for(int i = 0; i < " << pikocOptions.numRuns << "; ++i)\n";
@@ -196,7 +375,7 @@ bool CPUBackend::emitRunFunc(std::ostream& outfile)
 	tabs = "    ";
 
   // copy fresh state to device
-  outfile << tabs << "memcpy(d_mutableState, &h_mutableState, sizeof(" << psum.mutableState_type << "));\n";
+  outfile << tabs << "pikoMutableState.copyFrom(h_mutableState);\n";
   outfile << tabs << "constState = h_constState;\n";
 	outfile << "\n";
   writeKernelCalls(tabs, outfile);
@@ -205,13 +384,14 @@ bool CPUBackend::emitRunFunc(std::ostream& outfile)
   outfile << tabs << "}\n";
 
   if(pikocOptions.enableTimers) {
-    outfile << tabs << "kernelTime = clock() - kernelTime;\n";
+    outfile << tabs << "kernelTime = pikoWallTimeMs() - kernelTime;\n";
   }
 
 	outfile << "\n";
   outfile << "// Get Output\n";
   outfile << "  pixelData = pikoScreen.getData();\n";
   outfile << "\n";
+  writeRecorderOutput("  ", outfile);
 
   outfile << "// Free stages and input\n";
   outfile << "  " << "h_input.free();\n";
@@ -226,31 +406,31 @@ bool CPUBackend::emitRunFunc(std::ostream& outfile)
   outfile << "\n";
 
   outfile << "  pikoScreen.free();\n";
-  outfile << "  std::free(d_mutableState);\n";
+  outfile << "  pikoMutableState.free();\n";
   outfile << "\n";
 
   if(pikocOptions.enableTimers) {
-    outfile << "  totalTime = clock() - totalTime;\n";
+    outfile << "  totalTime = pikoWallTimeMs() - totalTime;\n";
     outfile << "  printf(\"\\n\");\n";
     outfile << "  printf(\"Number of timed pipeline runs: " << pikocOptions.numRuns
             << "\\n\");\n";
-    outfile << "  printf(\"Setup Time        (sec): %f\\n\", "
-            << "((float) setupTime) / CLOCKS_PER_SEC);\n";
+    outfile << "  printf(\"Setup Time        (msec): %f\\n\", setupTime);\n";
 		if(pikocOptions.numRuns == 0) {
-			outfile << "  printf(\"Avg Kernel Time   (sec): No timed runs\\n\");\n";
+			outfile << "  printf(\"Avg Kernel Time   (msec): No timed runs\\n\");\n";
 		}
 		else {
-			outfile << "  printf(\"Avg Kernel Time   (sec): %f\\n\", "
-				<< "((float) kernelTime) / CLOCKS_PER_SEC / " << pikocOptions.numRuns << ");\n";
+			outfile << "  printf(\"Avg Kernel Time   (msec): %f\\n\", "
+				<< "kernelTime / " << pikocOptions.numRuns << ");\n";
 		}
-    outfile << "  printf(\"Total Time        (sec): %f\\n\", "
-            << "((float) totalTime) / CLOCKS_PER_SEC);\n";
+    outfile << "  printf(\"Total Time        (msec): %f\\n\", totalTime);\n";
 		outfile << "\n";
   }
 
-  outfile << "  glutDisplayFunc(pikoDisplayFunc);\n";
-  outfile << "  glClearColor(0.0, 0.0, 0.0, 1.0);\n";
-  outfile << "  glutMainLoop();\n";
+  if(!pikocOptions.headless) {
+    outfile << "  glutDisplayFunc(pikoDisplayFunc);\n";
+    outfile << "  glClearColor(0.0, 0.0, 0.0, 1.0);\n";
+    outfile << "  glutMainLoop();\n";
+  }
 
   outfile << "}\n";
   outfile << "\n";
@@ -262,11 +442,52 @@ bool CPUBackend::emitRunFunc(std::ostream& outfile)
 	return true;
 }
 
-// We rely on the host compiler to compile the device code for the CPU backend.
-// Thus, nothing needs to be done in this function.
+// At -O0 we rely on the host compiler to compile the device code for the CPU
+// backend. Otherwise the optimized module is emitted as a native object that
+// is linked with the host code.
 bool CPUBackend::emitDeviceCode(std::string filename)
 {
-	return true;
+  if(!emitObject())
+    return true;
+
+  std::string outFileName = filename + ".o";
+
+  // Dump LLVM IR to stderr
+  if(pikocOptions.dumpIR)
+    module->dump();
+
+  llvm::TargetMachine* targetMachine = createTargetMachine();
+  if(!targetMachine)
+    return false;
+
+  std::string error;
+  llvm::tool_output_file objOut(outFileName.c_str(), error,
+    llvm::raw_fd_ostream::F_Binary);
+  if(!error.empty()) {
+    llvm::errs() << "Unable to open object output file: " << outFileName << "\n";
+    delete targetMachine;
+    return false;
+  }
+
+  llvm::PassManager codeGenPassMgr;
+  codeGenPassMgr.add(new llvm::DataLayout(*targetMachine->getDataLayout()));
+
+  {
+    llvm::formatted_raw_ostream objStream(objOut.os());
+    if(targetMachine->addPassesToEmitFile(codeGenPassMgr, objStream,
+        llvm::TargetMachine::CGFT_ObjectFile))
+    {
+      llvm::errs() << "LLVM target cannot emit an object file\n";
+      delete targetMachine;
+      return false;
+    }
+
+    codeGenPassMgr.run(*module);
+  }
+
+  objOut.keep();
+  delete targetMachine;
+  return true;
 }
 
 bool CPUBackend::emitAllocateFunc(std::ostream& outfile)
@@ -280,7 +501,7 @@ bool CPUBackend::emitAllocateFunc(std::ostream& outfile)
   outfile << "#define PIKO_" << pipeName << "_ALLOC_AND_RUN_H\n";
   outfile << "\n";
 
-  outfile << "#include <ctime>\n";
+  outfile << "#include \"piko/timer.h\"\n";
   outfile << "\n";  
 
 
@@ -296,6 +517,7 @@ bool CPUBackend::emitAllocateFunc(std::ostream& outfile)
   outfile << "  mutableState_->isMutableState();\n";
   outfile << "  inputData[0].isPrim();\n";
   outfile << "  count_ = count;\n";
+  outfile << "  pikoNumCPUThreads = pikoGetNumCPUThreads();\n";
 
   outfile << "  // Create a device pointer for each stage\n";
   outfile << "  // and map the host pointer to the device pointer\n";
@@ -330,8 +552,8 @@ bool CPUBackend::emitAllocateFunc(std::ostream& outfile)
   outfile << "  // Piko initial input data\n";
   outfile << "  h_input.allocate();\n";
   outfile << "  h_input.copyData(inputData, count);\n";
-  outfile << "  d_mutableState = (" << psum.mutableState_type << "*) malloc(sizeof("
-    << psum.mutableState_type << "));\n";
+  outfile << "  pikoMutableState.allocate(*constState_, *mutableState_);\n";
+  outfile << "  d_mutableState = pikoMutableState.get();\n";
   outfile << "  d_input = &h_input;\n";
   outfile << "\n";
 
@@ -356,6 +578,7 @@ bool CPUBackend::emitAllocateFunc(std::ostream& outfile)
     }
   }
   outfile << "\n";
+  writeRecorderSetup("  ", outfile);
 
   outfile << "  printf(\"Done...\\n\");\n";
   outfile << "}\n";
@@ -370,7 +593,7 @@ bool CPUBackend::emitPrepareFunc(std::ostream& outfile)
   outfile << "void " << pipeName << "::prepare()\n";
   outfile << "{\n";
   //outfile << "  printf(\"Preparing...\\n\");\n";
-  outfile << tabs << "memcpy(d_mutableState, mutableState_, sizeof(" << psum.mutableState_type << "));\n";
+  outfile << tabs << "pikoMutableState.copyFrom(*mutableState_);\n";
   outfile << tabs << "constState = *constState_;\n";
   //outfile << "  printf(\"Done...\\n\");\n";
   outfile << "}\n";
@@ -415,8 +638,9 @@ bool CPUBackend::emitDestroyFunc(std::ostream& outfile)
   }
   outfile << "\n";
 
+  writeRecorderOutput("  ", outfile);
   outfile << "  pikoScreen.free();\n";
-  outfile << "  std::free(d_mutableState);\n";
+  outfile << "  pikoMutableState.free();\n";
   outfile << "  printf(\"Done...\\n\");\n";
   outfile << "}\n";
 
@@ -440,7 +664,9 @@ void CPUBackend::writeKernelCalls(std::string tabs, std::ostream& outfile)
   outfile << tabs << "numThreads = 512;\n";
 
   params = "d_input, d_" + kernelList[0][0]->name;
-  writeKernelRunner(curKernel, params, tabs, outfile, false);
+  writeRecorderTimerStart(curKernel, kernelList[0][0], "PIKO_PHASE_ASSIGNBIN", tabs, outfile);
+  writeKernelRunner(curKernel, params, tabs, outfile, false, "");
+  writeRecorderTimerStop(curKernel, kernelList[0][0], "PIKO_PHASE_ASSIGNBIN", tabs, outfile);
   outfile << "\n";
 
   curKernel += 1;
@@ -467,6 +693,8 @@ void CPUBackend::writeKernelCalls(std::string tabs, std::ostream& outfile)
       tabs += "  ";
     }
 
+    writeRecorderBins(stg, tabs, outfile);
+
     // Schedule
     if(!optimize || !stg->schedules[0].trivial) {
       outfile << tabs << "// Schedule\n";
@@ -482,7 +710,9 @@ void CPUBackend::writeKernelCalls(std::string tabs, std::ostream& outfile)
       outfile << "\n";
 
       params = "d_" + stgName;
-      writeKernelRunner(curKernel, params, tabs, outfile, false);
+      writeRecorderTimerStart(curKernel, stg, "PIKO_PHASE_SCHEDULE", tabs, outfile);
+      writeKernelRunner(curKernel, params, tabs, outfile, false, "");
+      writeRecorderTimerStop(curKernel, stg, "PIKO_PHASE_SCHEDULE", tabs, outfile);
       outfile << "\n";
 
       curKernel += 1;
@@ -495,7 +725,10 @@ void CPUBackend::writeKernelCalls(std::string tabs, std::ostream& outfile)
     //outfile << tabs << "numThreads = " << stg->threadsPerTile << ";\n";
 
     params = "d_" + stgName;
-    writeKernelRunner(curKernel, params, tabs, outfile, true);
+    writeRecorderTimerStart(curKernel, stg, "PIKO_PHASE_PROCESS", tabs, outfile);
+    writeKernelRunner(curKernel, params, tabs, outfile, true,
+      traceLabel(stg, "PIKO_PHASE_PROCESS"));
+    writeRecorderTimerStop(curKernel, stg, "PIKO_PHASE_PROCESS", tabs, outfile);
     outfile << "\n";
 
     if(stg->loopEnd || (optimize && ii->back()->loopEnd) ) {
@@ -517,14 +750,15 @@ void CPUBackend::writeKernelCalls(std::string tabs, std::ostream& outfile)
 
     curKernel += 1;
   }
+
+  writeRecorderFrameEnd(tabs, outfile);
 }
 
+// traceLabel names the per-bin spans of parallel kernels in --trace builds
 void CPUBackend::writeKernelRunner(int kernelID, std::string params, std::string tabs,
-  std::ostream& outfile, bool parallel)
+  std::ostream& outfile, bool parallel, std::string traceLabel)
 {
-  std::ostringstream ss;
-  ss << "kernel" << kernelID;
-  std::string kernel = ss.str();
+  std::string kernel = kernelNames[kernelID];
 
   if(pikocOptions.displayGrid)
     outfile << tabs << "printf(\"kernel launch: blocks \%d, thread \%d\\n\",numBlocks, numThreads);\n";
@@ -533,7 +767,7 @@ void CPUBackend::writeKernelRunner(int kernelID, std::string params, std::string
 
   if(parallel)
   {
-    outfile << tabs << "  unsigned numCPUThreads = 64;\n";
+    outfile << tabs << "  unsigned numCPUThreads = pikoNumCPUThreads;\n";
     outfile << tabs << "  std::vector<std::thread> cpuThreads;\n";
     outfile << "\n";
     outfile << tabs << "  blockDim_x = numThreads;\n";
@@ -542,14 +776,26 @@ void CPUBackend::writeKernelRunner(int kernelID, std::string params, std::string
     outfile << tabs << "  {\n";
     outfile << tabs << "    cpuThreads.push_back(std::thread([&, this, t]()\n";
     outfile << tabs << "    {\n";
+    if(countingEvents()) {
+      outfile << tabs << "      PikoPerfGroup pikoPerf;\n";
+      outfile << tabs << "      pikoPerf.open();\n";
+    }
     outfile << tabs << "      int lastBlock = std::min(numBlocks, (t+1) * blocksPerThread);\n";
     outfile << tabs << "      for(int curBlock = t * blocksPerThread; curBlock < lastBlock; ++curBlock)\n";
     outfile << tabs << "      {\n";
     outfile << tabs << "        blockIdx_x = curBlock;\n";
+    if(tracing())
+      outfile << tabs << "        double traceStart = pikoTrace.now();\n";
     outfile << tabs << "        for(threadIdx_x = 0; threadIdx_x < numThreads; ++threadIdx_x) {\n";
     outfile << tabs << "          " << kernel << "(" << params << ");\n";
     outfile << tabs << "        }\n";
+    if(tracing()) {
+      outfile << tabs << "        pikoTrace.endBin(t, \"" << traceLabel << "\", " << kernelID
+        << ", curBlock, traceStart);\n";
+    }
     outfile << tabs << "      }\n";
+    if(countingEvents())
+      outfile << tabs << "      pikoStats_.addWorkerCounters(t, pikoPerf);\n";
     outfile << tabs << "    }\n";
     outfile << tabs << "    ));\n";
     outfile << tabs << "  }\n";
@@ -20,6 +20,7 @@ bool PTXBackend::emitDefines(std::ostream& outfile) {
   outfile << "  CUmodule    cuModule; \\\n";
   outfile << "  CUdeviceptr d_pikoScreen; \\\n";
   outfile << "  CUdeviceptr d_mutableState; \\\n";
+  outfile << "  PikoDeviceState<" << psum.mutableState_type << "> pikoMutableState; \\\n";
   outfile << "  CUdeviceptr d_input; \\\n";
 
   for(std::vector<stageSummary>::iterator
@@ -45,6 +46,8 @@ bool PTXBackend::emitDefines(std::ostream& outfile) {
       outfile << "  CUfunction kernel" << curKernel++ << "; \\\n";
     outfile << "  CUfunction kernel" << curKernel++ << "; \\\n";
   }
+  writeRecorderMembers(outfile);
+  writeCaptureMembers(outfile);
   outfile << "  ;\n\n";
 
   // outfile << "  CUfunction kernel0;             \\\n";
@@ -73,33 +76,39 @@ bool PTXBackend::emitRunFunc(std::ostream& outfile)
   outfile << "\n";
   outfile << "#include <cuda.h>\n";
   outfile << "#include <builtin_types.h>\n";
-  outfile << "#include <GL/glut.h>\n";
+  if(!pikocOptions.headless)
+    outfile << "#include <GL/glut.h>\n";
   outfile << "\n";
 
   outfile << "#include \"internal/cudaMacros.h\"\n";
-  outfile << "#include <ctime>\n";
+  outfile << "#include \"piko/timer.h\"\n";
   outfile << "\n";
 
+  writeRecorderDecl(outfile);
+
   outfile << "unsigned* pixelData;\n";
   outfile << "ConstantState* constStateInternal;\n";
   outfile << "\n";
 
-  outfile << "void pikoDisplayFunc() {\n";
-  outfile << "  //glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);\n";
-  outfile << "  glDrawPixels(constStateInternal->screenSizeX, constStateInternal->screenSizeY,\n";
-  outfile << "    GL_RGBA, GL_UNSIGNED_BYTE, pixelData);\n";
-  outfile << "  glutSwapBuffers();\n";
-  outfile << "}\n";
-  outfile << "\n";
+  // Headless builds leave the last frame in pixelData for the caller
+  if(!pikocOptions.headless) {
+    outfile << "void pikoDisplayFunc() {\n";
+    outfile << "  //glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);\n";
+    outfile << "  glDrawPixels(constStateInternal->screenSizeX, constStateInternal->screenSizeY,\n";
+    outfile << "    GL_RGBA, GL_UNSIGNED_BYTE, pixelData);\n";
+    outfile << "  glutSwapBuffers();\n";
+    outfile << "}\n";
+    outfile << "\n";
+  }
 
   outfile << "void " << pipeName << "::run (" 
     << psum.constState_type << "& h_constState, " << psum.mutableState_type << "& h_mutableState, "
     << psum.input_type << "* inputData, int count) {\n";
 
   if(pikocOptions.enableTimers) {
-    outfile << "  clock_t totalTime, setupTime, kernelTime;\n";
-    outfile << "  totalTime = clock();\n";
-    outfile << "  setupTime = clock();\n";
+    outfile << "  double totalTime, setupTime, kernelTime;\n";
+    outfile << "  totalTime = pikoWallTimeMs();\n";
+    outfile << "  setupTime = pikoWallTimeMs();\n";
     outfile << "\n";
   }
 
@@ -169,12 +178,14 @@ bool PTXBackend::emitRunFunc(std::ostream& outfile)
   outfile << "  int numBlocks;\n";
   outfile << "  int numThreads;\n";
   outfile << "  CUdeviceptr d_mutableState;\n";
+  outfile << "  PikoDeviceState<" << psum.mutableState_type << "> pikoMutableState;\n";
   outfile << "  CUdeviceptr d_input;\n";
   outfile << "  PikoArray<" << psum.input_type << "> h_input;\n";
   outfile << "\n";
   outfile << "  h_input.allocate();\n";
   outfile << "  h_input.copyData(inputData, count);\n";
-  outfile << "  CUDACHECK(cuMemAlloc(&d_mutableState, sizeof(" << psum.mutableState_type << ")));\n";
+  outfile << "  pikoMutableState.allocate(h_constState, h_mutableState);\n";
+  outfile << "  d_mutableState = pikoMutableState.get();\n";
   outfile << "  CUDACHECK(cuMemAlloc(&d_input, sizeof(" << psum.input_type << ")));\n";
   outfile << "  CUDACHECK(cuMemcpyHtoD(d_input, &h_input, sizeof(" << psum.input_type << ")));\n";
   outfile << "\n";
@@ -203,6 +214,7 @@ bool PTXBackend::emitRunFunc(std::ostream& outfile)
             << "    sizeof(" << stgType << ")));\n";
   }
   outfile << "\n";
+  writeRecorderSetup("  ", outfile);
 
   int curKernel = 0;
 
@@ -225,7 +237,7 @@ bool PTXBackend::emitRunFunc(std::ostream& outfile)
   }
 
   if(pikocOptions.enableTimers) {
-    outfile << "  setupTime = clock() - setupTime;\n";
+    outfile << "  setupTime = pikoWallTimeMs() - setupTime;\n";
     outfile << "\n";
   }
 
@@ -244,8 +256,7 @@ bool PTXBackend::emitRunFunc(std::ostream& outfile)
   outfile << tabs << "CUDACHECK(cuModuleGetGlobal(&d_constState, &constStateSize, cuModule, \"constState\"));\n";
   outfile << tabs << "CUDACHECK(cuMemcpyHtoD(d_constState, &h_constState, sizeof("
     << psum.constState_type << ")));\n";
-  outfile << tabs << "CUDACHECK(cuMemcpyHtoD(d_mutableState, &h_mutableState, sizeof("
-    << psum.mutableState_type << ")));\n";
+  outfile << tabs << "pikoMutableState.copyFrom(h_mutableState);\n";
 	outfile << "\n";
   writeKernelCalls(tabs, outfile);
   outfile << tabs << "CUDACHECK(cuCtxSynchronize());\n";
@@ -258,7 +269,7 @@ bool PTXBackend::emitRunFunc(std::ostream& outfile)
   outfile << tabs << "// ------ TIMED RUNS -----\n";
   outfile << tabs << "// -----------------------\n";
   if(pikocOptions.enableTimers) {
-    outfile << tabs << "kernelTime = clock();\n";
+    outfile << tabs << "kernelTime = pikoWallTimeMs();\n";
   }
   // loop starts here
   outfile << tabs << "for(int i = 0; i < " << pikocOptions.numRuns << "; ++i)\n";
@@ -269,8 +280,7 @@ bool PTXBackend::emitRunFunc(std::ostream& outfile)
   outfile << tabs << "CUdeviceptr d_constState;\n";
   outfile << tabs << "size_t      constStateSize;\n";
   outfile << tabs << "CUDACHECK(cuModuleGetGlobal(&d_constState, &constStateSize, cuModule, \"constState\"));\n";
-  outfile << tabs << "CUDACHECK(cuMemcpyHtoD(d_mutableState, &h_mutableState, sizeof("
-    << psum.mutableState_type << ")));\n";
+  outfile << tabs << "pikoMutableState.copyFrom(h_mutableState);\n";
   outfile << tabs << "CUDACHECK(cuMemcpyHtoD(d_constState, &h_constState, sizeof("
     << psum.constState_type << ")));\n";
 	outfile << "\n";
@@ -281,13 +291,14 @@ bool PTXBackend::emitRunFunc(std::ostream& outfile)
   outfile << tabs << "}\n";
 
   if(pikocOptions.enableTimers) {
-    outfile << tabs << "kernelTime = clock() - kernelTime;\n";
+    outfile << tabs << "kernelTime = pikoWallTimeMs() - kernelTime;\n";
   }
 
 	outfile << "\n";
   outfile << "// Get Output\n";
   outfile << "  pixelData = pikoScreen.getData();\n";
   outfile << "\n";
+  writeRecorderOutput("  ", outfile);
 
   outfile << "// Free stages and input\n";
   outfile << "  " << "h_input.free();\n";
@@ -316,32 +327,32 @@ bool PTXBackend::emitRunFunc(std::ostream& outfile)
 */
   outfile << "  pikoScreen.free();\n";
   outfile << "  CUDACHECK(cuMemFree(d_pikoScreen));\n";
-  outfile << "  CUDACHECK(cuMemFree(d_mutableState));\n";
+  outfile << "  pikoMutableState.free();\n";
   outfile << "  CUDACHECK(cuCtxDestroy(cuContext));\n";
   outfile << "\n";
 
   if(pikocOptions.enableTimers) {
-    outfile << "  totalTime = clock() - totalTime;\n";
+    outfile << "  totalTime = pikoWallTimeMs() - totalTime;\n";
     outfile << "  printf(\"\\n\");\n";
     outfile << "  printf(\"Number of timed pipeline runs: " << pikocOptions.numRuns
             << "\\n\");\n";
-    outfile << "  printf(\"Setup Time        (msec): %f\\n\", "
-            << "((float) setupTime * 1000.0f) / (float)CLOCKS_PER_SEC);\n";
+    outfile << "  printf(\"Setup Time        (msec): %f\\n\", setupTime);\n";
 		if(pikocOptions.numRuns == 0) {
 			outfile << "  printf(\"Avg Kernel Time   (msec): No timed runs\\n\");\n";
 		}
 		else {
 			outfile << "  printf(\"Avg Kernel Time   (msec): %f\\n\", "
-				<< "((float) kernelTime * 1000.0f) / (float)CLOCKS_PER_SEC / " << pikocOptions.numRuns << ".0f );\n";
+				<< "kernelTime / " << pikocOptions.numRuns << ");\n";
 		}
-    outfile << "  printf(\"Total Time        (msec): %f\\n\", "
-            << "((float) totalTime * 1000.0f) / (float)CLOCKS_PER_SEC);\n";
+    outfile << "  printf(\"Total Time        (msec): %f\\n\", totalTime);\n";
 		outfile << "\n";
   }
 
-  outfile << "  glutDisplayFunc(pikoDisplayFunc);\n";
-  outfile << "  glClearColor(0.0, 0.0, 0.0, 1.0);\n";
-  outfile << "  glutMainLoop();\n";
+  if(!pikocOptions.headless) {
+    outfile << "  glutDisplayFunc(pikoDisplayFunc);\n";
+    outfile << "  glClearColor(0.0, 0.0, 0.0, 1.0);\n";
+    outfile << "  glutMainLoop();\n";
+  }
 
   outfile << "}\n";
   outfile << "\n";
@@ -658,11 +669,12 @@ bool PTXBackend::emitAllocateFunc(std::ostream& outfile)
   outfile << "\n";
   outfile << "#include <cuda.h>\n";
   outfile << "#include <builtin_types.h>\n";
-  outfile << "#include <GL/glut.h>\n";
+  if(!pikocOptions.headless)
+    outfile << "#include <GL/glut.h>\n";
   outfile << "\n";
 
   outfile << "#include \"internal/cudaMacros.h\"\n";
-  outfile << "#include <ctime>\n";
+  outfile << "#include \"piko/timer.h\"\n";
   outfile << "\n";  
 
 
@@ -732,7 +744,8 @@ bool PTXBackend::emitAllocateFunc(std::ostream& outfile)
   outfile << "  // Piko initial input data\n";
   outfile << "  h_input.allocate();\n";
   outfile << "  h_input.copyData(inputData, count);\n";
-  outfile << "  CUDACHECK(cuMemAlloc(&d_mutableState, sizeof(" << psum.mutableState_type << ")));\n";
+  outfile << "  pikoMutableState.allocate(*constState_, *mutableState_);\n";
+  outfile << "  d_mutableState = pikoMutableState.get();\n";
   outfile << "  CUDACHECK(cuMemAlloc(&d_input, sizeof(" << psum.input_type << ")));\n";
   outfile << "  CUDACHECK(cuMemcpyHtoD(d_input, &h_input, sizeof(" << psum.input_type << ")));\n";
 
@@ -760,6 +773,7 @@ bool PTXBackend::emitAllocateFunc(std::ostream& outfile)
             << "    sizeof(" << stgType << ")));\n";
   }
   outfile << "\n";
+  writeRecorderSetup("  ", outfile);
 
 
 
@@ -800,8 +814,7 @@ bool PTXBackend::emitPrepareFunc(std::ostream& outfile)
   outfile << tabs << "CUDACHECK(cuModuleGetGlobal(&d_constState, &constStateSize, cuModule, \"constState\"));\n";
   outfile << tabs << "CUDACHECK(cuMemcpyHtoD(d_constState, constState_, sizeof("
     << psum.constState_type << ")));\n";
-  outfile << tabs << "CUDACHECK(cuMemcpyHtoD(d_mutableState, mutableState_, sizeof("
-    << psum.mutableState_type << ")));\n";
+  outfile << tabs << "pikoMutableState.copyFrom(*mutableState_);\n";
   //outfile << "  printf(\"Done...\\n\");\n";
   outfile << "}\n";
 
@@ -835,6 +848,7 @@ bool PTXBackend::emitDestroyFunc(std::ostream& outfile)
   outfile << "void " << pipeName << "::destroy()\n";
   outfile << "{\n";
   outfile << "  printf(\"Freeing...\\n\");\n";
+  writeRecorderOutput("  ", outfile);
   outfile << "  // Free stages and input\n";
   outfile << "  h_input.free();\n";
   outfile << "  CUDACHECK(cuMemFree(d_input));\n";
@@ -850,7 +864,7 @@ bool PTXBackend::emitDestroyFunc(std::ostream& outfile)
 
   outfile << "  pikoScreen.free();\n";
   outfile << "  CUDACHECK(cuMemFree(d_pikoScreen));\n";
-  outfile << "  CUDACHECK(cuMemFree(d_mutableState));\n";
+  outfile << "  pikoMutableState.free();\n";
   outfile << "  CUDACHECK(cuCtxDestroy(cuContext));\n";
   outfile << "  printf(\"Done...\\n\");\n";
   outfile << "}\n";
@@ -866,9 +880,11 @@ void PTXBackend::writeKernelFunctionFetch(int kernelID, bool bAllocate, std::ost
   ss << "kernel" << kernelID;
   std::string kernel = ss.str();
 
+  // The CUfunction handles keep the short names, the module symbols carry
+  // the stage and phase
   if(bAllocate) outfile << "  CUfunction " << kernel << ";\n";
   outfile << "  CUDACHECK(cuModuleGetFunction(&" << kernel
-    << ", cuModule, \"" << kernel << "\"));\n";
+    << ", cuModule, \"" << kernelNames[kernelID] << "\"));\n";
   outfile << "\n";
 }
 
@@ -887,7 +903,9 @@ void PTXBackend::writeKernelCalls(std::string tabs, std::ostream& outfile)
   outfile << tabs << "numThreads = 512;\n";
 
   params = "&d_input, &d_" + kernelList[0][0]->name;
+  writeRecorderTimerStart(curKernel, kernelList[0][0], "PIKO_PHASE_ASSIGNBIN", tabs, outfile);
   writeKernelRunner(curKernel, params, tabs, outfile);
+  writeRecorderTimerStop(curKernel, kernelList[0][0], "PIKO_PHASE_ASSIGNBIN", tabs, outfile);
   outfile << "\n";
 
   curKernel += 1;
@@ -914,6 +932,8 @@ void PTXBackend::writeKernelCalls(std::string tabs, std::ostream& outfile)
       tabs += "  ";
     }
 
+    writeRecorderBins(stg, tabs, outfile);
+
     // Schedule
     if(!optimize || !stg->schedules[0].trivial) {
       outfile << tabs << "// Schedule\n";
@@ -929,7 +949,9 @@ void PTXBackend::writeKernelCalls(std::string tabs, std::ostream& outfile)
       outfile << "\n";
 
       params = "&d_" + stgName;
+      writeRecorderTimerStart(curKernel, stg, "PIKO_PHASE_SCHEDULE", tabs, outfile);
       writeKernelRunner(curKernel, params, tabs, outfile);
+      writeRecorderTimerStop(curKernel, stg, "PIKO_PHASE_SCHEDULE", tabs, outfile);
       outfile << "\n";
 
       curKernel += 1;
@@ -937,6 +959,7 @@ void PTXBackend::writeKernelCalls(std::string tabs, std::ostream& outfile)
 
     // Process
     outfile << tabs << "// Process\n";
+    writeRecorderTimerStart(curKernel, stg, "PIKO_PHASE_PROCESS", tabs, outfile);
     if(stg->schedules[0].schedPolicy == schedAll) {
       int tileSplitSize = stg->schedules[0].tileSplitSize;
       outfile << tabs << "numBlocks = 1000;\n";
@@ -957,6 +980,7 @@ void PTXBackend::writeKernelCalls(std::string tabs, std::ostream& outfile)
       params = "&d_" + stgName;
       writeKernelRunner(curKernel, params, tabs, outfile);
     }
+    writeRecorderTimerStop(curKernel, stg, "PIKO_PHASE_PROCESS", tabs, outfile);
     outfile << "\n";
 
     if(stg->loopEnd || (optimize && ii->back()->loopEnd) ) {
@@ -981,6 +1005,8 @@ void PTXBackend::writeKernelCalls(std::string tabs, std::ostream& outfile)
 
     curKernel += 1;
   }
+
+  writeRecorderFrameEnd(tabs, outfile);
 }
 
 void PTXBackend::writeKernelRunner(int kernelID, std::string params, std::string tabs,
@@ -1,5 +1,8 @@
 #include "Backend/PikoBackend.hpp"
 
+#include "clang/AST/DeclCXX.h"
+#include "clang/AST/Mangle.h"
+#include "clang/AST/RecursiveASTVisitor.h"
 #include "clang/Basic/TargetInfo.h"
 #include "clang/CodeGen/ModuleBuilder.h"
 #include "clang/Frontend/CompilerInstance.h"
@@ -11,6 +14,9 @@
 #include "llvm/PassManager.h"
 #include "llvm/Transforms/IPO/PassManagerBuilder.h"
 #include "llvm/Transforms/IPO.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <set>
 
 bool PikoBackend::createLLVMModule()
 {
@@ -32,6 +38,11 @@ bool PikoBackend::createLLVMModule()
     args.push_back("-I");
     args.push_back(pikocOptions.includeDirs[i].c_str());
   }
+  for(int i = 0; i < pikocOptions.defines.size(); ++i) {
+    args.push_back("-D");
+    args.push_back(pikocOptions.defines[i].c_str());
+  }
+  addClangArgs(args);
   args.push_back(pikocOptions.inFileName.c_str());
 
   llvm::ArrayRef<const char*> argList(args);
@@ -42,6 +53,7 @@ bool PikoBackend::createLLVMModule()
 
   clang::TargetOptions TO; 
   TO.Triple = this->getTargetTriple() + "-" + pikocOptions.osString;
+  setTargetOptions(TO);
   clang::TargetInfo* feTarget =
     clang::TargetInfo::CreateTargetInfo(CI->getDiagnostics(), TO);
   CI->setTarget(feTarget);
@@ -68,10 +80,78 @@ bool PikoBackend::createLLVMModule()
   }
 
   this->module = llvmCodeGen->GetModule();
+  this->compiler = CI;
 
 	return true;
 }
 
+// Collects the definitions of the stage methods and emit specializations
+// of a pipeline
+class StageFunctionVisitor : public clang::RecursiveASTVisitor<StageFunctionVisitor> {
+public:
+	explicit StageFunctionVisitor(PipeSummary& psum) {
+		for(std::vector<stageSummary>::iterator
+			ii = psum.stages.begin(), ie = psum.stages.end(); ii != ie; ++ii)
+		{
+			stageTypes.insert(ii->type);
+			specializations.insert("__emitSpecializationAssignBin" + ii->type + "__");
+			specializations.insert("__emitSpecializationProcess" + ii->type + "__");
+		}
+	}
+
+	bool VisitFunctionDecl(clang::FunctionDecl* decl) {
+		if(!decl->doesThisDeclarationHaveABody())
+			return true;
+
+		std::string name = decl->getNameAsString();
+		clang::CXXMethodDecl* method = llvm::dyn_cast<clang::CXXMethodDecl>(decl);
+		if(method) {
+			if(stageTypes.count(method->getParent()->getNameAsString())
+				&& (name == "emit" || name == "assignBin" || name == "process"))
+				decls.push_back(decl);
+		}
+		else if(specializations.count(name))
+			decls.push_back(decl);
+		return true;
+	}
+
+	std::vector<clang::FunctionDecl*> decls;
+
+private:
+	std::set<std::string> stageTypes;
+	std::set<std::string> specializations;
+};
+
+std::vector<llvm::Function*> PikoBackend::stageFunctions()
+{
+	std::vector<llvm::Function*> functions;
+	if(!compiler || !module)
+		return functions;
+
+	clang::ASTContext& context = compiler->getASTContext();
+	StageFunctionVisitor visitor(psum);
+	visitor.TraverseDecl(context.getTranslationUnitDecl());
+
+	clang::MangleContext* mangler = context.createMangleContext();
+	for(int i = 0; i < visitor.decls.size(); ++i) {
+		std::string name;
+		llvm::raw_string_ostream out(name);
+		if(mangler->shouldMangleDeclName(visitor.decls[i]))
+			mangler->mangleName(visitor.decls[i], out);
+		else
+			out << visitor.decls[i]->getName();
+		out.flush();
+
+		// methods that are never called have no definition in the module
+		llvm::Function* function = module->getFunction(name);
+		if(function && !function->isDeclaration())
+			functions.push_back(function);
+	}
+	delete mangler;
+
+	return functions;
+}
+
 bool PikoBackend::optimizeLLVMModule(int optLevel)
 {
   llvm::PassManagerBuilder   passBuilder;
@@ -99,3 +179,188 @@ bool PikoBackend::optimizeLLVMModule(int optLevel)
 
   return true;
 }
+
+int PikoBackend::stageIndex(stageSummary* stg)
+{
+  for(int i = 0; i < psum.stagesInOrder.size(); ++i) {
+    if(psum.stagesInOrder[i] == stg)
+      return i;
+  }
+  return -1;
+}
+
+void PikoBackend::writeRecorderDecl(std::ostream& outfile)
+{
+  if(profiling()) {
+    outfile << "#include \"piko/profile.h\"\n";
+    outfile << "\n";
+    outfile << "PikoProfileRecorder pikoProfile;\n";
+    outfile << "\n";
+  }
+  if(benchmarking()) {
+    outfile << "#include \"piko/bench.h\"\n";
+    outfile << "\n";
+    outfile << "PikoBenchRecorder pikoBench;\n";
+    outfile << "\n";
+  }
+  if(tracing()) {
+    outfile << "#include \"piko/trace.h\"\n";
+    outfile << "\n";
+    outfile << "PikoTraceRecorder pikoTrace;\n";
+    outfile << "\n";
+  }
+  if(reportingBins()) {
+    outfile << "#include \"piko/binreport.h\"\n";
+    outfile << "\n";
+    outfile << "PikoBinReportRecorder pikoBinReport;\n";
+    outfile << "\n";
+  }
+}
+
+// Lines of __PIKO_DEVICE_MEMBERS__: the recorder of --instrument builds is a
+// member of the pipeline, so that it can be queried through getStats()
+void PikoBackend::writeRecorderMembers(std::ostream& outfile)
+{
+  if(!instrumenting())
+    return;
+
+  outfile << "  PikoStats pikoStats_; \\\n";
+  outfile << "  PikoStats& getStats() { return pikoStats_; } \\\n";
+}
+
+void PikoBackend::writeRecorderSetup(std::string tabs, std::ostream& outfile)
+{
+  std::vector<std::string> recorders;
+  if(profiling())     recorders.push_back("pikoProfile");
+  if(benchmarking())  recorders.push_back("pikoBench");
+  if(instrumenting()) recorders.push_back("pikoStats_");
+  if(reportingBins()) recorders.push_back("pikoBinReport");
+
+  for(int r = 0; r < recorders.size(); ++r) {
+    outfile << tabs << recorders[r] << ".reset();\n";
+    for(int i = 0; i < psum.stagesInOrder.size(); ++i) {
+      outfile << tabs << recorders[r] << ".addStage(\"" << psum.stagesInOrder[i]->name << "\");\n";
+    }
+  }
+
+  // Tracing and hardware counters are only supported by the CPU runner,
+  // which declares the number of worker threads
+  if(countingEvents())
+    outfile << tabs << "pikoStats_.setNumWorkers(pikoNumCPUThreads);\n";
+  if(tracing())
+    outfile << tabs << "pikoTrace.reset(pikoNumCPUThreads);\n";
+}
+
+void PikoBackend::writeRecorderBins(stageSummary* stg, std::string tabs, std::ostream& outfile)
+{
+  if(profiling())
+    outfile << tabs << "pikoProfile.recordBins(" << stageIndex(stg) << ", " << stg->name << ");\n";
+  if(reportingBins())
+    outfile << tabs << "pikoBinReport.recordBins(" << stageIndex(stg) << ", " << stg->name << ");\n";
+}
+
+void PikoBackend::writeRecorderTimerStart(int kernel, stageSummary* stg, std::string phase,
+  std::string tabs, std::ostream& outfile)
+{
+  if(instrumenting()) {
+    outfile << tabs << "pikoStats_.beginKernel(" << kernel << ", " << stageIndex(stg) << ", " << phase << ");\n";
+    if(phase == "PIKO_PHASE_ASSIGNBIN")
+      outfile << tabs << "pikoStats_.setInput(count);\n";
+    else
+      outfile << tabs << "pikoStats_.countInput(" << stg->name << ");\n";
+    writeRecorderOutputCount(stg, phase, "Before", tabs, outfile);
+  }
+  if(profiling())
+    outfile << tabs << "pikoProfile.startTimer();\n";
+  if(benchmarking())
+    outfile << tabs << "pikoBench.startTimer();\n";
+  if(instrumenting())
+    outfile << tabs << "pikoStats_.startTimer();\n";
+  if(tracing())
+    outfile << tabs << "pikoTrace.beginKernel();\n";
+}
+
+void PikoBackend::writeRecorderTimerStop(int kernel, stageSummary* stg, std::string phase,
+  std::string tabs, std::ostream& outfile)
+{
+  if(tracing())
+    outfile << tabs << "pikoTrace.endKernel(\"" << traceLabel(stg, phase) << "\", " << kernel << ");\n";
+  if(instrumenting())
+    outfile << tabs << "pikoStats_.stopTimer();\n";
+  if(benchmarking())
+    outfile << tabs << "pikoBench.stopTimer(" << stageIndex(stg) << ", " << phase << ");\n";
+  if(profiling())
+    outfile << tabs << "pikoProfile.stopTimer(" << stageIndex(stg) << ", " << phase << ");\n";
+  if(instrumenting()) {
+    writeRecorderOutputCount(stg, phase, "After", tabs, outfile);
+    outfile << tabs << "pikoStats_.endKernel();\n";
+  }
+}
+
+// Name of the spans of a kernel in --trace output, e.g. "raster process"
+std::string PikoBackend::traceLabel(stageSummary* stg, std::string phase)
+{
+  std::string name = stg->name + " ";
+  if(phase == "PIKO_PHASE_ASSIGNBIN")     name += "assignBin";
+  else if(phase == "PIKO_PHASE_SCHEDULE") name += "schedule";
+  else                                    name += "process";
+  return name;
+}
+
+// AssignBin fills the bins of its own stage, Process those of the other
+// stages. Schedule does not emit primitives.
+void PikoBackend::writeRecorderOutputCount(stageSummary* stg, std::string phase,
+  std::string when, std::string tabs, std::ostream& outfile)
+{
+  for(int i = 0; i < psum.stagesInOrder.size(); ++i) {
+    stageSummary* other = psum.stagesInOrder[i];
+    bool counted = (phase == "PIKO_PHASE_ASSIGNBIN") ? (other == stg)
+                 : (phase == "PIKO_PHASE_PROCESS")   ? (other != stg)
+                 : false;
+    if(counted)
+      outfile << tabs << "pikoStats_.countOutput" << when << "(" << other->name << ");\n";
+  }
+}
+
+void PikoBackend::writeRecorderFrameEnd(std::string tabs, std::ostream& outfile)
+{
+  // Frames of a benchmark are marked by the harness, around prepare() too
+  if(profiling())
+    outfile << tabs << "pikoProfile.endFrame();\n";
+  if(instrumenting())
+    outfile << tabs << "pikoStats_.endFrame();\n";
+  if(tracing())
+    outfile << tabs << "pikoTrace.endFrame();\n";
+  if(reportingBins())
+    outfile << tabs << "pikoBinReport.endFrame();\n";
+}
+
+void PikoBackend::writeRecorderOutput(std::string tabs, std::ostream& outfile)
+{
+  if(profiling()) {
+    outfile << tabs << "pikoProfile.write(\"" << pikocOptions.profileGenFile << "\", \""
+      << psum.name << "\");\n";
+  }
+  if(tracing())
+    outfile << tabs << "pikoTrace.write(\"" << pikocOptions.traceFile << "\");\n";
+  if(reportingBins()) {
+    outfile << tabs << "pikoBinReport.write(\"" << pikocOptions.binReportFile << "\", "
+      << (pikocOptions.binHeatmap ? "true" : "false") << ");\n";
+  }
+}
+
+// Reads the input back from h_input, which also holds the primitives a
+// caller copied in after allocate(), e.g. vertices transformed on the host
+void PikoBackend::writeCaptureMembers(std::ostream& outfile)
+{
+  if(!pikocOptions.capture)
+    return;
+
+  std::string inputType = psum.input_type;
+  outfile << "  bool writeCapture(const char* filename) { \\\n";
+  outfile << "    std::vector<" << inputType << "> pikoCaptureInput(count_ > 0 ? count_ : 1); \\\n";
+  outfile << "    int n = (count_ > 0) ? h_input.readData(&pikoCaptureInput[0], count_) : 0; \\\n";
+  outfile << "    return pikoWriteCapture(filename, *constState_, *mutableState_, \\\n";
+  outfile << "      &pikoCaptureInput[0], n); \\\n";
+  outfile << "  } \\\n";
+}
@@ -1,15 +1,9 @@
 #include "Frontend/PikoASTConsumer.hpp"
 
-bool PikoASTConsumer::HandleTopLevelDecl(clang::DeclGroupRef dr) {
-	for(clang::DeclGroupRef::iterator b = dr.begin(), e = dr.end();
-				b != e; ++b)
-	{
-		switch(passNum_)
-		{
-			default: break;
-			case 1: stageVisitor_.TraverseDecl(*b); break;
-			case 2: pipeVisitor_.TraverseDecl(*b); break;
-		}
-	}
-	return true;
+#include "clang/AST/ASTContext.h"
+
+void PikoASTConsumer::HandleTranslationUnit(clang::ASTContext &ctx) {
+	clang::TranslationUnitDecl *tu = ctx.getTranslationUnitDecl();
+	stageVisitor_.TraverseDecl(tu);
+	pipeVisitor_.TraverseDecl(tu);
 }
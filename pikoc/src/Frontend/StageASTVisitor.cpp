@@ -107,7 +107,7 @@ bool StageASTVisitor::addAssignBinSummary(clang::CXXMethodDecl *m, stageSummary
 	assignBinSummary assignSum;
 
 	//Get source code for this phase
-	if(!getSourceCode(m, srcMgr, assignSum.codeFile, assignSum.sourceCode)) {
+	if(!getSourceCode(m, srcMgr, assignSum.codeFile, assignSum.codeLine, assignSum.sourceCode)) {
 		llvm::errs() << "Unable to get assignBin source code for " << stageType << "\n";
 		return false;
 	}
@@ -216,6 +216,7 @@ bool StageASTVisitor::addScheduleSummary(clang::CXXMethodDecl *m, stageSummary *
 	bool schedCustomFound = false;
 	bool waitPolicyFound = false;
 	bool waitCustomFound = false;
+	bool exclusiveFound = false;
 	int numChildren = 0;
 
 	std::string stageType = m->getParent()->getNameAsString();
@@ -223,7 +224,7 @@ bool StageASTVisitor::addScheduleSummary(clang::CXXMethodDecl *m, stageSummary *
 	scheduleSummary schedSum;
 
 	//Get source code for this phase
-	if(!getSourceCode(m, srcMgr, schedSum.codeFile, schedSum.sourceCode)) {
+	if(!getSourceCode(m, srcMgr, schedSum.codeFile, schedSum.codeLine, schedSum.sourceCode)) {
 		llvm::errs() << "Unable to get assignBin source code for " << stageType << "\n";
 		return false;
 	}
@@ -274,6 +275,11 @@ bool StageASTVisitor::addScheduleSummary(clang::CXXMethodDecl *m, stageSummary *
 			else
 				schedCustomFound = true;
 		}
+		// if it is specifyExclusiveBins
+		else if(getCalledFuncName(expr) == "specifyExclusiveBins") {
+			exclusiveFound = true;
+			schedSum.exclusiveBinsDeclared = true;
+		}
 		// if it is specifyWait
 		else if(getCalledFuncName(expr) == "specifyWait") {
 			clang::Expr* arg = expr->getArg(0);
@@ -354,7 +360,9 @@ bool StageASTVisitor::addScheduleSummary(clang::CXXMethodDecl *m, stageSummary *
 		schedSum.waitPolicy = waitCustom;
 
 	//schedule is trivial if the only thing in it is a schedule policy
-	//or schedule and wait policies
+	//or schedule and wait policies, and the exclusive bins declaration
+	if(exclusiveFound)
+		numChildren -= 1;
 	if((schedPolicyFound && numChildren == 1)
 			|| (schedPolicyFound && waitPolicyFound && numChildren == 2))
 		schedSum.trivial = true;
@@ -379,7 +387,7 @@ bool StageASTVisitor::addProcessSummary(clang::CXXMethodDecl *m, stageSummary *s
 	processSummary processSum;
 
 	//Get source code for this phase
-	if(!getSourceCode(m, srcMgr, processSum.codeFile, processSum.sourceCode)) {
+	if(!getSourceCode(m, srcMgr, processSum.codeFile, processSum.codeLine, processSum.sourceCode)) {
 		llvm::errs() << "Unable to get assignBin source code for " << stageType << "\n";
 		return false;
 	}
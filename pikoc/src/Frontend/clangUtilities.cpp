@@ -62,8 +62,9 @@ bool findFuncRecur(clang::Stmt *s, std::string name) {
 	return false;
 }
 
+// srcLine is the line of the method declaration, src its body
 bool getSourceCode(clang::CXXMethodDecl *m, const clang::SourceManager &srcMgr,
-										std::string &srcFileName, std::string &src) {
+										std::string &srcFileName, int &srcLine, std::string &src) {
   std::string codeStartLineString;
 	int codeStartLine;
   std::string codeEndLineString;
@@ -74,6 +75,7 @@ bool getSourceCode(clang::CXXMethodDecl *m, const clang::SourceManager &srcMgr,
   std::getline(ss1, srcFileName, ':');
   std::getline(ss1, codeStartLineString, ':');
   std::istringstream(codeStartLineString) >> codeStartLine;
+  srcLine = codeStartLine;
 
   std::istringstream ss2(assignBinSrc.getEnd().printToString(srcMgr));
   std::getline(ss2, codeEndLineString, ':');
@@ -0,0 +1,392 @@
+#include "PikoCache.hpp"
+#include "PikocParams.hpp"
+
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "clang/Basic/SourceManager.h"
+#include "clang/Basic/TargetInfo.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Frontend/Utils.h"
+#include "clang/Lex/Preprocessor.h"
+
+#include "llvm/Support/Host.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+// 64-bit FNV-1a, run twice with different offset bases to get a 128-bit key
+static unsigned long long fnv1a(const std::string& s, unsigned long long hash)
+{
+	for(size_t i = 0; i < s.size(); ++i) {
+		hash ^= (unsigned char) s[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+static bool copyFile(const std::string& from, const std::string& to)
+{
+	std::ifstream in(from.c_str(), std::ios::binary);
+	if(!in.good())
+		return false;
+
+	// Write to a temporary name of this writer first so that a concurrent
+	// reader never sees a partially written file, and concurrent writers of
+	// the same file do not write into each other's
+	static int tmpCount = 0;
+	std::ostringstream tmpName;
+	tmpName << to << ".tmp." << getpid() << "." << tmpCount++;
+	std::string tmp = tmpName.str();
+
+	std::ofstream out(tmp.c_str(), std::ios::binary | std::ios::trunc);
+	if(!out.good())
+		return false;
+
+	out << in.rdbuf();
+	out.close();
+	if(out.fail()) {
+		unlink(tmp.c_str());
+		return false;
+	}
+
+	if(rename(tmp.c_str(), to.c_str()) != 0) {
+		unlink(tmp.c_str());
+		return false;
+	}
+	return true;
+}
+
+static bool fileExists(const std::string& name)
+{
+	struct stat status;
+	return stat(name.c_str(), &status) == 0;
+}
+
+PikoCache::PikoCache(const PikocOptions& options)
+	: pikocOptions(options)
+	, lastHits(0)
+	, lastMisses(0)
+{
+	cacheDir = options.cacheDir;
+	if(cacheDir == "")
+		cacheDir = options.workingDir + "/.pikoc_cache";
+}
+
+// Whether name is one of the headers pikoc generates in the working directory
+static bool isGeneratedHeader(const std::string& name)
+{
+	size_t slash = name.rfind('/');
+	std::string base = (slash == std::string::npos) ? name : name.substr(slash + 1);
+	return base == "__pikoDefines.h" || base == "__pikoCompiledPipe.h";
+}
+
+bool PikoCache::preprocessInput(bool analysisPhase, std::string& text,
+	std::set<std::string>& files)
+{
+	clang::CompilerInstance CI;
+	CI.createDiagnostics(0,0);
+
+	// Same configuration as the analysis phase in main, or as the device
+	// phase of the backends
+	std::vector<const char*> args;
+	args.push_back("-xc++");
+	args.push_back("-D__PIKOC__");
+	args.push_back("-D__PIKOC_DEVICE__");
+	if(analysisPhase) {
+		args.push_back("-D__PIKOC_HOST__");
+		args.push_back("-D__PIKOC_ANALYSIS_PHASE__");
+	}
+	args.push_back("-I");
+	args.push_back(pikocOptions.workingDir.c_str());
+	args.push_back("-I");
+	args.push_back(pikocOptions.clangResourceDir.c_str());
+	args.push_back("-I");
+	args.push_back(pikocOptions.pikoIncludeDir.c_str());
+	args.push_back("-I");
+	args.push_back(pikocOptions.cudaIncludeDir.c_str());
+	for(int i = 0; i < pikocOptions.includeDirs.size(); ++i) {
+		args.push_back("-I");
+		args.push_back(pikocOptions.includeDirs[i].c_str());
+	}
+	for(int i = 0; i < pikocOptions.defines.size(); ++i) {
+		args.push_back("-D");
+		args.push_back(pikocOptions.defines[i].c_str());
+	}
+	args.push_back(pikocOptions.inFileName.c_str());
+
+	llvm::ArrayRef<const char*> argList(args);
+	llvm::IntrusiveRefCntPtr<clang::DiagnosticsEngine> diagnostics(&CI.getDiagnostics());
+	clang::CompilerInvocation *compInvoke =
+		clang::createInvocationFromCommandLine(argList, diagnostics);
+	if(!compInvoke)
+		return false;
+	CI.setInvocation(compInvoke);
+
+	// The generated files are outputs of this run, so they are not read.
+	// The device phase sees the target macro of __pikoDefines.h; the rest of
+	// it follows from the analysis phase, which is hashed as well.
+	std::string defines;
+	if(!analysisPhase)
+		defines = (pikocOptions.target == pikoc::PTX)
+			? "#define __PIKOC_PTX__\n" : "#define __PIKOC_CPU__\n";
+	CI.getPreprocessorOpts().addRemappedFile(
+		pikocOptions.workingDir + "/__pikoDefines.h",
+		llvm::MemoryBuffer::getMemBufferCopy(defines, "__pikoDefines.h"));
+	CI.getPreprocessorOpts().addRemappedFile(
+		pikocOptions.workingDir + "/__pikoCompiledPipe.h",
+		llvm::MemoryBuffer::getMemBuffer("", "__pikoCompiledPipe.h"));
+
+	clang::TargetOptions TO;
+	TO.Triple = llvm::sys::getDefaultTargetTriple();
+	clang::TargetInfo* feTarget =
+		clang::TargetInfo::CreateTargetInfo(CI.getDiagnostics(), TO);
+	CI.setTarget(feTarget);
+	CI.createFileManager();
+	CI.createSourceManager(CI.getFileManager());
+	CI.createPreprocessor();
+	clang::Preprocessor &PP = CI.getPreprocessor();
+
+	const clang::FileEntry* inFile = CI.getFileManager().getFile(pikocOptions.inFileName);
+	if(!inFile)
+		return false;
+	CI.getSourceManager().createMainFileID(inFile);
+	CI.getDiagnosticClient().BeginSourceFile(CI.getLangOpts(), &PP);
+
+	PP.EnterMainSourceFile();
+
+	clang::Token tok;
+	do {
+		PP.Lex(tok);
+		if(tok.isAtStartOfLine())
+			text += "\n";
+		else if(tok.hasLeadingSpace())
+			text += " ";
+		text += PP.getSpelling(tok);
+	} while(tok.isNot(clang::tok::eof));
+
+	CI.getDiagnosticClient().EndSourceFile();
+
+	for(clang::SourceManager::fileinfo_iterator
+		ii = CI.getSourceManager().fileinfo_begin(),
+		ie = CI.getSourceManager().fileinfo_end(); ii != ie; ++ii)
+	{
+		std::string name = ii->first->getName();
+		if(!isGeneratedHeader(name))
+			files.insert(name);
+	}
+
+	// Without the generated defines, the device phase can take #error
+	// branches that the real compile does not. Only the analysis phase
+	// decides whether the input is valid.
+	return !analysisPhase || !CI.getDiagnostics().hasErrorOccurred();
+}
+
+std::string PikoCache::optionString()
+{
+	std::stringstream ss;
+
+	ss << "pikoc " << PIKOC_VERSION << " " << __DATE__ << " " << __TIME__ << "\n";
+	ss << "target "       << pikocOptions.target       << "\n";
+	ss << "optimize "     << pikocOptions.optimize     << "\n";
+	ss << "enableTimers " << pikocOptions.enableTimers << "\n";
+	ss << "inlineDevice " << pikocOptions.inlineDevice << "\n";
+	ss << "displayGrid "  << pikocOptions.displayGrid  << "\n";
+	ss << "headless "     << pikocOptions.headless     << "\n";
+	ss << "bench "        << pikocOptions.bench        << "\n";
+	ss << "instrument "   << pikocOptions.instrument   << "\n";
+	ss << "perfCounters " << pikocOptions.perfCounters << "\n";
+	ss << "capture "      << pikocOptions.capture      << "\n";
+	ss << "numRuns "      << pikocOptions.numRuns      << "\n";
+	ss << "optLevel "     << pikocOptions.optLevel     << "\n";
+	ss << "debugInfo "    << pikocOptions.debugInfo    << "\n";
+	ss << "march "        << pikocOptions.cpuName      << "\n";
+	ss << "mattr "        << pikocOptions.cpuFeatures  << "\n";
+	ss << "os "           << pikocOptions.osString     << "\n";
+	ss << "input "        << pikocOptions.inFileName   << "\n";
+	ss << "profileGen "   << pikocOptions.profileGenFile << "\n";
+	ss << "trace "        << pikocOptions.traceFile    << "\n";
+	ss << "binReport "    << pikocOptions.binReportFile << "\n";
+	ss << "binHeatmap "   << pikocOptions.binHeatmap   << "\n";
+	for(int i = 0; i < pikocOptions.defines.size(); ++i)
+		ss << "define "     << pikocOptions.defines[i]   << "\n";
+
+	// The plan depends on the contents of the profile, not on its name
+	if(pikocOptions.profileFile != "") {
+		std::ifstream profile(pikocOptions.profileFile.c_str());
+		ss << "profile\n" << profile.rdbuf();
+	}
+
+	return ss.str();
+}
+
+std::vector<std::string> PikoCache::outputFiles()
+{
+	std::vector<std::string> files;
+
+	files.push_back("__pikoDefines.h");
+	files.push_back("__pikoCompiledPipe.h");
+	if(pikocOptions.target == pikoc::PTX)
+		files.push_back("__pikoCompiledPipe.ptx");
+	else if(pikocOptions.target == pikoc::CPU && pikocOptions.optLevel > 0)
+		files.push_back("__pikoCompiledPipe.o");
+
+	return files;
+}
+
+bool PikoCache::computeKey()
+{
+	// The preprocessed input of both phases, and the whole text of every file
+	// either of them includes. The files cover the branches that depend on
+	// the generated defines, like PIKO_EXCLUSIVE_BINS().
+	std::string text;
+	std::set<std::string> files;
+	if(!preprocessInput(true, text, files) || !preprocessInput(false, text, files))
+		return false;
+
+	for(std::set<std::string>::iterator
+		ii = files.begin(), ie = files.end(); ii != ie; ++ii)
+	{
+		std::ifstream in(ii->c_str(), std::ios::binary);
+		std::stringstream contents;
+		contents << in.rdbuf();
+		text += "\nfile " + *ii + "\n" + contents.str();
+	}
+
+	text += optionString();
+
+	char buf[33];
+	snprintf(buf, sizeof(buf), "%016llx%016llx",
+		fnv1a(text, 14695981039346656037ULL),
+		fnv1a(text, 0x6c62272e07bb0142ULL));
+	key = buf;
+
+	return true;
+}
+
+bool PikoCache::fetch()
+{
+	if(key == "" || !fileExists(entryDir() + "/complete"))
+		return false;
+
+	std::vector<std::string> files = outputFiles();
+	for(int i = 0; i < files.size(); ++i) {
+		if(!copyFile(entryDir() + "/" + files[i],
+		             pikocOptions.workingDir + "/" + files[i]))
+			return false;
+	}
+
+	return true;
+}
+
+bool PikoCache::store()
+{
+	if(key == "")
+		return false;
+
+	mkdir(cacheDir.c_str(), 0755);
+	mkdir(entryDir().c_str(), 0755);
+
+	std::vector<std::string> files = outputFiles();
+	for(int i = 0; i < files.size(); ++i) {
+		if(!copyFile(pikocOptions.workingDir + "/" + files[i],
+		             entryDir() + "/" + files[i]))
+		{
+			llvm::errs() << "Unable to store " << files[i] << " in cache " << cacheDir << "\n";
+			return false;
+		}
+	}
+
+	// Written last: an entry is only used once all of its files are in place
+	std::ofstream marker((entryDir() + "/complete").c_str(), std::ios::trunc);
+	return marker.good();
+}
+
+static void parseStats(const std::string& text, long& hits, long& misses)
+{
+	hits = 0;
+	misses = 0;
+
+	std::istringstream in(text);
+	std::string name;
+	long value;
+	while(in >> name >> value) {
+		if(name == "hits")   hits = value;
+		if(name == "misses") misses = value;
+	}
+}
+
+static std::string readAll(int fd)
+{
+	std::string text;
+	char buf[256];
+	ssize_t n;
+	while((n = read(fd, buf, sizeof(buf))) > 0)
+		text.append(buf, n);
+	return text;
+}
+
+void PikoCache::readStats(long& hits, long& misses)
+{
+	hits = 0;
+	misses = 0;
+
+	int fd = open((cacheDir + "/stats").c_str(), O_RDONLY);
+	if(fd < 0)
+		return;
+	flock(fd, LOCK_SH);
+	parseStats(readAll(fd), hits, misses);
+	flock(fd, LOCK_UN);
+	close(fd);
+}
+
+void PikoCache::updateStats(int hits, int misses)
+{
+	lastHits += hits;
+	lastMisses += misses;
+
+	// Other pikoc runs may share the cache: the file stays locked from the
+	// read to the write, so that none of their counts are lost
+	mkdir(cacheDir.c_str(), 0755);
+	int fd = open((cacheDir + "/stats").c_str(), O_RDWR | O_CREAT, 0644);
+	if(fd < 0)
+		return;
+	flock(fd, LOCK_EX);
+
+	long totalHits, totalMisses;
+	parseStats(readAll(fd), totalHits, totalMisses);
+
+	std::stringstream out;
+	out << "hits "   << totalHits + hits     << "\n";
+	out << "misses " << totalMisses + misses << "\n";
+	std::string text = out.str();
+
+	bool ok = lseek(fd, 0, SEEK_SET) == 0 && ftruncate(fd, 0) == 0
+		&& write(fd, text.c_str(), text.size()) == (ssize_t) text.size();
+	if(!ok)
+		llvm::errs() << "Unable to update " << cacheDir << "/stats\n";
+
+	flock(fd, LOCK_UN);
+	close(fd);
+}
+
+void PikoCache::printStats()
+{
+	long totalHits, totalMisses;
+	readStats(totalHits, totalMisses);
+
+	// neither a hit nor a miss: the cache was not used
+	const char* result = lastHits ? "hit" : (lastMisses ? "miss" : "bypassed");
+	llvm::errs() << "pikoc cache: " << result;
+	if(key != "")
+		llvm::errs() << " (" << key << ")";
+	llvm::errs() << "\n";
+	llvm::errs() << "  cache directory: " << cacheDir << "\n";
+	llvm::errs() << "  total hits:      " << totalHits << "\n";
+	llvm::errs() << "  total misses:    " << totalMisses << "\n";
+}
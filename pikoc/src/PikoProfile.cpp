@@ -0,0 +1,159 @@
+#include "PikoProfile.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <stdio.h>
+
+using namespace std;
+
+double stageProfile::meanBinPrims() const {
+  return (activeBins > 0) ? prims / activeBins : 0.0;
+}
+
+double stageProfile::imbalance() const {
+  double mean = meanBinPrims();
+  if(mean <= 0 || samples <= 0)
+    return 1.0;
+  return (maxBinPrims / samples) / mean;
+}
+
+double stageProfile::activeFraction() const {
+  if(numBins <= 0 || samples <= 0)
+    return 0.0;
+  return activeBins / (samples * numBins);
+}
+
+bool PikoProfile::load(const string& file){
+  filename = file;
+
+  ifstream in(file.c_str());
+  if(!in.is_open()){
+    printf("Unable to open profile %s\n", file.c_str());
+    return false;
+  }
+
+  string line;
+  int version = 0;
+  while(getline(in, line)){
+    stringstream ss(line);
+    string tag;
+    if(!(ss >> tag))
+      continue;
+
+    if(tag == "pikoprofile")
+      ss >> version;
+    else if(tag == "pipe")
+      ss >> pipeName;
+    else if(tag == "frames")
+      ss >> frames;
+    else if(tag == "launch_ms")
+      ss >> launchMs;
+    else if(tag == "stage"){
+      stageProfile sp;
+      string key;
+      ss >> sp.name;
+      while(ss >> key){
+        if     (key == "bins")        ss >> sp.numBins;
+        else if(key == "samples")     ss >> sp.samples;
+        else if(key == "prims")       ss >> sp.prims;
+        else if(key == "active")      ss >> sp.activeBins;
+        else if(key == "max")         ss >> sp.maxBinPrims;
+        else if(key == "assign_ms")   ss >> sp.assignMs;
+        else if(key == "schedule_ms") ss >> sp.scheduleMs;
+        else if(key == "process_ms")  ss >> sp.processMs;
+        else { string skip; ss >> skip; }
+      }
+      sp.hist = stages[sp.name].hist;
+      stages[sp.name] = sp;
+    }
+    else if(tag == "hist"){
+      string name;
+      long long count;
+      ss >> name;
+      vector<long long>& hist = stages[name].hist;
+      hist.clear();
+      while(ss >> count)
+        hist.push_back(count);
+    }
+  }
+
+  if(version != 1){
+    printf("Unsupported profile format in %s\n", file.c_str());
+    return false;
+  }
+  if(frames <= 0){
+    printf("Profile %s does not contain any recorded frames\n", file.c_str());
+    return false;
+  }
+
+  // Everything below works on per-frame values
+  for(map<string, stageProfile>::iterator ii = stages.begin(), ie = stages.end();
+      ii != ie; ++ii)
+  {
+    stageProfile& sp = ii->second;
+    sp.samples     /= frames;
+    sp.prims       /= frames;
+    sp.activeBins  /= frames;
+    sp.maxBinPrims /= frames;
+    sp.assignMs    /= frames;
+    sp.scheduleMs  /= frames;
+    sp.processMs   /= frames;
+  }
+
+  return true;
+}
+
+const stageProfile* PikoProfile::findStage(const string& stageName) const {
+  map<string, stageProfile>::const_iterator it = stages.find(stageName);
+  if(it == stages.end())
+    return NULL;
+  return &it->second;
+}
+
+bool PikoProfile::shouldFuse(const stageSummary& s1, const stageSummary& s2) const {
+  const stageProfile* p1 = findStage(s1.name);
+  const stageProfile* p2 = findStage(s2.name);
+
+  // no measurements: keep the static decision
+  if(p1 == NULL || p2 == NULL || p2->samples <= 0)
+    return true;
+
+  int launchesPerSample = s2.schedules[0].trivial ? 1 : 2;
+
+  double unfusedMs = p2->scheduleMs + p2->processMs
+                   + launchMs * launchesPerSample * p2->samples;
+  double fusedMs   = p2->processMs * p1->imbalance() / p2->imbalance();
+
+  bool fuse = (fusedMs <= unfusedMs);
+
+  printf("* Profile: %s -> %s: fused %.3f ms, separate %.3f ms: %s\n",
+    s1.name.c_str(), s2.name.c_str(), fusedMs, unfusedMs,
+    fuse ? "fuse" : "do not fuse");
+
+  return fuse;
+}
+
+void PikoProfile::printBinSizeAdvice(const vector<stageSummary>& stgs) const {
+  for(unsigned i=0; i<stgs.size(); i++){
+    const stageSummary& stg = stgs[i];
+    const stageProfile* sp = findStage(stg.name);
+
+    // full-screen bins cannot be resized
+    if(sp == NULL || stg.binsize.peekx() == 0 || stg.binsize.peeky() == 0 || sp->prims <= 0)
+      continue;
+
+    double imb = sp->imbalance();
+    double mean = sp->meanBinPrims();
+
+    if(imb > 4.0 && mean >= 2.0 * stg.threadsPerTile){
+      printf("* Profile: %s bins are imbalanced (max/mean %.1f, mean %.1f prims); "
+             "try %dx%d bins\n", stg.name.c_str(), imb, mean,
+             stg.binsize.peekx() / 2, stg.binsize.peeky() / 2);
+    }
+    else if(sp->activeFraction() < 0.25 && imb < 2.0){
+      printf("* Profile: %s uses %.0f%% of its bins; try %dx%d bins\n",
+             stg.name.c_str(), 100.0 * sp->activeFraction(),
+             stg.binsize.peekx() * 2, stg.binsize.peeky() * 2);
+    }
+  }
+}
@@ -1,4 +1,5 @@
 #include "PikoSummary.hpp"
+#include "PikoProfile.hpp"
 
 #include <algorithm>
 #include <sstream>
@@ -416,6 +417,8 @@ for(unsigned i=0; i<branches.size(); i++) {
 // // }}}
 
   printf("* Number of Kernels: %d\n", curKernelID);
+  if(profile != NULL)
+    profile->printBinSizeAdvice(stages);
 	printf("|Level ID|\n");
 
   curKernelID         = -1;
@@ -683,6 +686,34 @@ void PipeSummary::displaySummary(){
 }
 
 
+// A bin is processed by one thread at a time when its schedule gives it to
+// a single block (LoadBalance without tile splitting, DirectMap or
+// Serialize) whose threads run one after another, as they do on the CPU, or
+// which has only one thread. A loop in the pipeline can refill a bin while
+// it is processed, so no stage of such a pipeline qualifies.
+// specifyExclusiveBins() stands in for the schedule policy.
+void PipeSummary::findExclusiveBins(eArchs arch){
+
+  printf("* Exclusive bins: ");
+  for(unsigned i=0; i<stages.size(); i++){
+    scheduleSummary& sch = stages[i].schedules[0];
+
+    bool oneBlockPerBin =
+         (sch.schedPolicy == schedLoadBalance && sch.tileSplitSize == 0)
+      || sch.schedPolicy == schedDirectMap
+      || sch.schedPolicy == schedSerialize;
+    bool serialThreads = (arch == archCPU) || (stages[i].threadsPerTile == 1);
+
+    stages[i].exclusiveBins = !hasLoop
+      && (sch.exclusiveBinsDeclared || oneBlockPerBin) && serialThreads;
+
+    if(stages[i].exclusiveBins)
+      printf("[%s%s] ", stages[i].name.c_str(),
+        (oneBlockPerBin ? "" : ", declared"));
+  }
+  printf("\n");
+}
+
 bool PipeSummary::canFuse(stageSummary& s1, stageSummary& s2, int whichSchedule,
     vector<stageSummary*>& doneStages){
 
@@ -730,12 +761,14 @@ bool PipeSummary::canFuse(stageSummary& s1, stageSummary& s2, int whichSchedule,
   
   preferLoadBalance = preferLoadBalance || (sch2.schedPolicy==schedLoadBalance);
 
+  bool fuse = false;
+
   if(  0//(sch2.waitPolicy == waitNone && s2.process.maxOutPrims<=8 && s2.assignBin.policy != assignCustom)
     || ((s2.binsize == s1.binsize) && sameCore && sch1.tileSplitSize == sch2.tileSplitSize)
     || 0
     )
   {
-    return true;
+    fuse = true;
   }
   // fusing schedAll
   else if(sch1.schedPolicy    ==  schedAll    && 
@@ -745,11 +778,38 @@ bool PipeSummary::canFuse(stageSummary& s1, stageSummary& s2, int whichSchedule,
           sch2.waitPolicy     ==  waitNone    &&
           sch1.tileSplitSize  ==  sch2.tileSplitSize)
   {
-    return true;
+    fuse = true;
   }
-  else
-  {
-    return false;
+
+  // measured costs from a profile can veto a fusion the policies allow
+  if(fuse && profile != NULL)
+    fuse = profile->shouldFuse(s1, s2);
+
+  return fuse;
+}
+
+vector<string> makeKernelNames(vector< vector<stageSummary*> >& kernelList, bool optimize)
+{
+  vector<string> names;
+
+  // The order must match generateKernels and the kernel calls of the backends
+  stringstream ss;
+  ss << "kernel" << names.size() << "_" << kernelList[0][0]->type << "_assignBin";
+  names.push_back(ss.str());
+
+  for(unsigned i = 0; i < kernelList.size(); ++i) {
+    stageSummary* stg = kernelList[i][0];
+
+    if(!optimize || !stg->schedules[0].trivial) {
+      ss.str("");
+      ss << "kernel" << names.size() << "_" << stg->type << "_schedule";
+      names.push_back(ss.str());
+    }
+
+    ss.str("");
+    ss << "kernel" << names.size() << "_" << stg->type << "_process";
+    names.push_back(ss.str());
   }
 
+  return names;
 }
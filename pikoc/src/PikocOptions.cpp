@@ -15,8 +15,24 @@ void PikocOptions::printOptions() {
 	llvm::errs() << "Options:\n";
 	llvm::errs() << "  -h, --help            Prints this help message\n";
 	llvm::errs() << "  -Idir                 Adds directory 'dir' to include search path\n";
+	llvm::errs() << "  -Dname[=value]        Defines macro 'name' for the pipeline and writes it to\n";
+	llvm::errs() << "                          __pikoDefines.h so the host build sees the same value\n";
 	llvm::errs() << "  --opt                 Enable Piko optimizations\n";
+	llvm::errs() << "  -O<level>             LLVM optimization level for CPU device code (0-3, default 0).\n";
+	llvm::errs() << "                          At -O1 and above device code is compiled to __pikoCompiledPipe.o\n";
+	llvm::errs() << "  -g                    Emit line tables for CPU device code compiled at -O1 and above,\n";
+	llvm::errs() << "                          so that profilers attribute kernel time to stage sources\n";
+	llvm::errs() << "  --march=<cpu>         Target CPU for CPU device code (default is the host CPU)\n";
+	llvm::errs() << "  --mattr=<features>    Target features for CPU device code (e.g. +avx2,+fma)\n";
 	llvm::errs() << "  --timer               Time the pipeline execution\n";
+	llvm::errs() << "  --bench               Record per-stage kernel times for a benchmark harness\n";
+	llvm::errs() << "                          (see piko/bench.h)\n";
+	llvm::errs() << "  --instrument          Record time, primitive counts and active bins of every kernel\n";
+	llvm::errs() << "                          launch, read through getStats() (see piko/instrument.h)\n";
+	llvm::errs() << "  --perf-counters       With --instrument, also count cycles, instructions, cache and\n";
+	llvm::errs() << "                          branch misses of every kernel launch (CPU target, Linux)\n";
+	llvm::errs() << "  --capture             Add writeCapture(file) to the pipeline, which saves the states and\n";
+	llvm::errs() << "                          input of a frame for replay (see piko/capture.h)\n";
 	llvm::errs() << "  --dumpIR              Print LLVM IR to stderr\n";
 	llvm::errs() << "  --numRuns=<x>         Runs the pipeline x times for average timing (default is 1)\n";
 	llvm::errs() << "  --target=<target>     Specifies the backend target for device code. Options are:\n";
@@ -24,6 +40,20 @@ void PikocOptions::printOptions() {
 	llvm::errs() << "                          CPU\n";
 	llvm::errs() << "  --edit                Pauses before PTX generation to allow editing of __pikoCompiledPipe.h\n";
 	llvm::errs() << "  --inline-device       Inline all device functions (if possible)\n";
+	llvm::errs() << "  --headless            Generate host code without OpenGL/GLUT. run() leaves the\n";
+	llvm::errs() << "                          frame in pixelData instead of opening a window\n";
+	llvm::errs() << "  --profile-gen[=file]  Instrument the pipeline to write a runtime profile\n";
+	llvm::errs() << "                          (default file is pikoProfile.txt)\n";
+	llvm::errs() << "  --profile=<file>      Plan kernels using a profile written by a --profile-gen build\n";
+	llvm::errs() << "  --trace[=file]        Record kernel and per-bin spans of the CPU runner as Chrome\n";
+	llvm::errs() << "                          trace-event JSON (default file is pikoTrace.json)\n";
+	llvm::errs() << "  --bin-report[=prefix] Write per-stage bin occupancy histograms, load imbalance and\n";
+	llvm::errs() << "                          the hottest bins to <prefix>.txt (default prefix is pikoBins)\n";
+	llvm::errs() << "  --bin-heatmap         With --bin-report, also write a PPM heatmap of the bin load\n";
+	llvm::errs() << "                          of every binned stage to <prefix>_<stage>.ppm\n";
+	llvm::errs() << "  --cache-dir=<dir>     Directory of the compile cache (default is ./.pikoc_cache)\n";
+	llvm::errs() << "  --no-cache            Do not reuse or store cached outputs\n";
+	llvm::errs() << "  --cache-stats         Report compile cache hits and misses\n";
 
 	llvm::errs() << "\n";
 }
@@ -68,6 +98,22 @@ PikocOptions PikocOptions::parseOptions(int argc, char *argv[]) {
 				exit(10);
 			}
 		}
+		else if(arg.size() == 3 && arg.substr(0, 2) == "-O") {
+			if(arg[2] < '0' || arg[2] > '3') {
+				llvm::errs() << "optimization level must be between 0 and 3\n";
+				exit(10);
+			}
+			options.optLevel = arg[2] - '0';
+		}
+		else if(arg == "-g") {
+			options.debugInfo = true;
+		}
+		else if(arg.substr(0, 8) == "--march=") {
+			options.cpuName = arg.substr(8);
+		}
+		else if(arg.substr(0, 8) == "--mattr=") {
+			options.cpuFeatures = arg.substr(8);
+		}
 		else if(arg.substr(0,9) == "--target=") {
 			std::string t = arg.substr(9);
 			if(t == "PTX")
@@ -82,9 +128,57 @@ PikocOptions PikocOptions::parseOptions(int argc, char *argv[]) {
 		else if(arg == "--inline-device") {
 			options.inlineDevice = true;
 		}
+		else if(arg == "--headless") {
+			options.headless = true;
+		}
+		else if(arg == "--bench") {
+			options.bench = true;
+		}
+		else if(arg == "--instrument") {
+			options.instrument = true;
+		}
+		else if(arg == "--capture") {
+			options.capture = true;
+		}
+		else if(arg == "--perf-counters") {
+			options.perfCounters = true;
+		}
 		else if(arg == "--displaygrid") {
 		  options.displayGrid = true;
 		}
+		else if(arg == "--profile-gen") {
+			options.profileGenFile = "pikoProfile.txt";
+		}
+		else if(arg.substr(0, 14) == "--profile-gen=") {
+			options.profileGenFile = arg.substr(14);
+		}
+		else if(arg.substr(0, 10) == "--profile=") {
+			options.profileFile = arg.substr(10);
+		}
+		else if(arg == "--trace") {
+			options.traceFile = "pikoTrace.json";
+		}
+		else if(arg.substr(0, 8) == "--trace=") {
+			options.traceFile = arg.substr(8);
+		}
+		else if(arg == "--bin-report") {
+			options.binReportFile = "pikoBins";
+		}
+		else if(arg.substr(0, 13) == "--bin-report=") {
+			options.binReportFile = arg.substr(13);
+		}
+		else if(arg == "--bin-heatmap") {
+			options.binHeatmap = true;
+		}
+		else if(arg.substr(0, 12) == "--cache-dir=") {
+			options.cacheDir = arg.substr(12);
+		}
+		else if(arg == "--no-cache") {
+			options.useCache = false;
+		}
+		else if(arg == "--cache-stats") {
+			options.cacheStats = true;
+		}
 		else if(arg.substr(0, 2) == "-I") {
 			std::string dir = arg.substr(2);
 
@@ -98,6 +192,14 @@ PikocOptions PikocOptions::parseOptions(int argc, char *argv[]) {
 				exit(10);
 			}
 		}
+		else if(arg.substr(0, 2) == "-D") {
+			std::string def = arg.substr(2);
+			if(def == "" || def[0] == '=') {
+				llvm::errs() << "Macro name missing in " << arg << "\n";
+				exit(10);
+			}
+			options.defines.push_back(def);
+		}
 		else {
 			llvm::errs() << "\nInvalid commandline options: " << arg << "\n";
 			printOptions();
@@ -105,6 +207,21 @@ PikocOptions PikocOptions::parseOptions(int argc, char *argv[]) {
 		}
 	}
 
+	if(options.traceFile != "" && options.target != pikoc::CPU) {
+		llvm::errs() << "--trace is only supported by the CPU target, ignoring it\n";
+		options.traceFile = "";
+	}
+
+	if(options.perfCounters && options.target != pikoc::CPU) {
+		llvm::errs() << "--perf-counters is only supported by the CPU target, ignoring it\n";
+		options.perfCounters = false;
+	}
+	if(options.perfCounters)
+		options.instrument = true;
+
+	if(options.binHeatmap && options.binReportFile == "")
+		options.binReportFile = "pikoBins";
+
 	options.osString = OS_STRING;
 
 	options.clangResourceDir = CLANG_RESOURCE_PATH;
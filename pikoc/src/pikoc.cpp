@@ -2,6 +2,8 @@
 #include "Backend/PTXBackend.hpp"
 #include "Frontend/PikoAction.hpp"
 #include "pikoc.hpp"
+#include "PikoCache.hpp"
+#include "PikoProfile.hpp"
 #include "PikocOptions.hpp"
 #include "PikocParams.hpp"
 #include "PikoSummary.hpp"
@@ -9,6 +11,8 @@
 #include <fstream>
 #include <iostream>
 #include <limits>
+#include <map>
+#include <sstream>
 #include <stdio.h>
 #include <unistd.h>
 
@@ -70,7 +74,9 @@ void generateEmitFunc(PipeSummary psum, std::ostream &outfile)
 {
 	std::string pipeName = psum.name;
 
-	outfile << "#ifdef __PIKOC_DEVICE__\n";
+	// When the device code is compiled into a separate object (CPU target at
+	// -O1 and above), the host compiler must not see the emit functions
+	outfile << "#if defined(__PIKOC_DEVICE__) && !defined(__PIKOC_DEVICE_EXTERN__)\n";
 	outfile << "#ifndef PIKO_" << pipeName << "_EMIT_FUNCS_H\n";
 	outfile << "#define PIKO_" << pipeName << "_EMIT_FUNCS_H\n\n";
 
@@ -190,17 +196,64 @@ void generateEmitFunc(PipeSummary psum, std::ostream &outfile)
 	}
 
 	outfile << "#endif // PIKO_" << pipeName << "_EMIT_FUNCS_H\n";
-	outfile << "#endif // __PIKOC_DEVICE__\n\n";
+	outfile << "#endif // __PIKOC_DEVICE__ && !__PIKOC_DEVICE_EXTERN__\n\n";
+}
+
+// Marks the end of a #line region in the generated code. fixLineDirectives
+// replaces it with the position in __pikoCompiledPipe.h once that is written.
+const char* generatedLineMarker = "#line __PIKOC_GENERATED_LINE__";
+
+// Wraps the call of a stage method in #line directives, so that debuggers and
+// sampling profilers attribute it to the method in the stage source
+std::string stageCall(std::string call, std::string codeFile, int codeLine)
+{
+	if(codeLine <= 0)
+		return call;
+
+	std::stringstream ss;
+	ss << "#line " << codeLine << " \"" << codeFile << "\"\n";
+	ss << call;
+	ss << generatedLineMarker << "\n";
+	return ss.str();
+}
+
+bool fixLineDirectives(std::string filename)
+{
+	std::ifstream infile(filename.c_str());
+	if(!infile.is_open())
+		return false;
+
+	std::vector<std::string> lines;
+	std::string l;
+	while(std::getline(infile, l))
+		lines.push_back(l);
+	infile.close();
+
+	std::ofstream outfile(filename.c_str(), std::ios::trunc);
+	if(!outfile.good())
+		return false;
+
+	for(int i = 0; i < lines.size(); ++i) {
+		if(lines[i] == generatedLineMarker)
+			outfile << "#line " << (i + 2) << " \"" << filename << "\"\n";
+		else
+			outfile << lines[i] << "\n";
+	}
+	return outfile.good();
 }
 
-void writeKernel(int kernelID, std::string params, std::string body,
+void writeKernel(std::string kernelName, std::string params, std::string body,
 								 std::ostream& outfile)
 {
 	outfile << "extern \"C\"\n";
-	outfile << "void kernel" << kernelID << "(" << params << ")\n";
+	outfile << "void " << kernelName << "(" << params << ")\n";
+	outfile << "#ifdef __PIKOC_DEVICE_EXTERN__\n";
+	outfile << ";\n";
+	outfile << "#else\n";
 	outfile << "{\n";
 	outfile << body;
-	outfile << "}\n\n";
+	outfile << "}\n";
+	outfile << "#endif\n\n";
 }
 
 void generateKernels(PipeSummary psum, std::ostream &outfile,
@@ -216,6 +269,7 @@ void generateKernels(PipeSummary psum, std::ostream &outfile,
 	outfile << "#include \"internal/globalVariables.h\"\n";
 	outfile << "#include \"piko/stage.h\"\n\n";
 
+	std::vector<std::string> kernelNames = makeKernelNames(kernelList, optimize);
 	int curKernel = 0;
 	std::string params;
 	std::string body;
@@ -232,9 +286,10 @@ void generateKernels(PipeSummary psum, std::ostream &outfile,
 	body += "  if(gid >= input->getNumPrims())\n";
 	body += "    return;\n";
 	body += "\n";
-	body += "  " + stgName + "->assignBin((*input)[gid]);\n";
+	body += stageCall("  " + stgName + "->assignBin((*input)[gid]);\n",
+		ssum->assignBin.codeFile, ssum->assignBin.codeLine);
 
-	writeKernel(curKernel, params, body, outfile);
+	writeKernel(kernelNames[curKernel], params, body, outfile);
 	curKernel += 1;
 	params = "";
 	body = "";
@@ -257,9 +312,10 @@ void generateKernels(PipeSummary psum, std::ostream &outfile,
 			body += "  if(gid >= " + stgName + "->getNumBins())\n";
 			body += "    return;\n";
 			body += "\n";
-			body += "  " + stgName + "->schedule(gid);\n";
+			body += stageCall("  " + stgName + "->schedule(gid);\n",
+				sch.codeFile, sch.codeLine);
 
-			writeKernel(curKernel, params, body, outfile);
+			writeKernel(kernelNames[curKernel], params, body, outfile);
 			curKernel += 1;
 			body = "";
 		}
@@ -293,11 +349,14 @@ void generateKernels(PipeSummary psum, std::ostream &outfile,
 
 		if(psum.hasLoop)
 			body += "		 " + ssum->primTypeIn + " prim = bin->fetchPrimAtomic();\n";
+		else if(ssum->exclusiveBins)
+			body += "		 " + ssum->primTypeIn + " prim = bin->fetchPrimExclusive();\n";
 		else
 			body += "		 " + ssum->primTypeIn + " prim = bin->fetchPrim();\n";
 
 		body += "	   prim.launchIdx = i;\n";
-		body += "    " + stgName + "->process(prim);\n";
+		body += stageCall("    " + stgName + "->process(prim);\n",
+			pro.codeFile, pro.codeLine);
 		//body += "    " + stgName + "->process(bin->fetchPrim(i));\n";
 		body += "  }\n";
 
@@ -307,7 +366,7 @@ void generateKernels(PipeSummary psum, std::ostream &outfile,
 			body += "  if(tid == 0) bin->updatePrimCount(-numPrims);\n";
 		}
 
-		writeKernel(curKernel, params, body, outfile);
+		writeKernel(kernelNames[curKernel], params, body, outfile);
 		curKernel += 1;
 		body = "";
 		params = "";
@@ -317,6 +376,55 @@ void generateKernels(PipeSummary psum, std::ostream &outfile,
 	outfile << "#endif // __PIKOC_DEVICE__\n\n";
 }
 
+// Macros given with -D on the pikoc command line. They are written to
+// __pikoDefines.h, which piko/stage.h includes, so that the host compiler
+// builds the stages with the same values as the device code.
+void generateUserDefines(const PikocOptions& pikocOptions, std::ostream &outfile)
+{
+	if(pikocOptions.defines.empty())
+		return;
+
+	outfile << "// pikoc -D options\n";
+	for(int i = 0; i < pikocOptions.defines.size(); ++i) {
+		std::string def = pikocOptions.defines[i];
+		std::string name = def;
+		std::string value = "1";
+
+		size_t eq = def.find('=');
+		if(eq != std::string::npos) {
+			name = def.substr(0, eq);
+			value = def.substr(eq + 1);
+		}
+
+		outfile << "#ifndef " << name << "\n";
+		outfile << "  #define " << name << " " << value << "\n";
+		outfile << "#endif\n";
+	}
+	outfile << "\n";
+}
+
+// PIKO_EXCLUSIVE_BINS(<stage type>) is 1 for the stage types whose every
+// instance has exclusive bins
+void generateExclusiveBinDefines(PipeSummary& psum, std::ostream &outfile)
+{
+	std::map<std::string, bool> exclusiveTypes;
+	for(int i = 0; i < psum.stages.size(); ++i) {
+		stageSummary& stg = psum.stages[i];
+		if(exclusiveTypes.find(stg.type) == exclusiveTypes.end())
+			exclusiveTypes[stg.type] = true;
+		exclusiveTypes[stg.type] = exclusiveTypes[stg.type] && stg.exclusiveBins;
+	}
+
+	outfile << "// stages whose bins are processed by one thread at a time\n";
+	for(std::map<std::string, bool>::iterator
+			ii = exclusiveTypes.begin(), ie = exclusiveTypes.end(); ii != ie; ++ii)
+	{
+		if(ii->second)
+			outfile << "#define __PIKO_EXCLUSIVE_BINS_" << ii->first << "__ 1\n";
+	}
+	outfile << "\n";
+}
+
 void PressEnterToContinue()
 {
 	std::cout << "Edit __pikoCompiledPipe.h then\n" << std::flush;
@@ -340,6 +448,22 @@ int main(int argc, char *argv[]) {
 
 	pikocOptions.workingDir = currentPath;
 
+	// Reuse the outputs of an earlier run if nothing that affects them has
+	// changed. --edit and --dumpIR need a real compile, so they bypass the cache
+	PikoCache cache(pikocOptions);
+	bool useCache = pikocOptions.useCache && !pikocOptions.edit
+		&& !pikocOptions.dumpIR && cache.computeKey();
+
+	if(useCache) {
+		if(cache.fetch()) {
+			cache.recordHit();
+			if(pikocOptions.cacheStats)
+				cache.printStats();
+			return 0;
+		}
+		cache.recordMiss();
+	}
+
 	std::string outFileNameDefines =
 		std::string(currentPath) + "/__pikoDefines.h";
 	std::string outFileNameH =
@@ -382,6 +506,10 @@ int main(int argc, char *argv[]) {
 		clangArgs.push_back("-I");
 		clangArgs.push_back(pikocOptions.includeDirs[i].c_str());
 	}
+	for(int i = 0; i < pikocOptions.defines.size(); ++i) {
+		clangArgs.push_back("-D");
+		clangArgs.push_back(pikocOptions.defines[i].c_str());
+	}
 
 	int clangArgCount = clangArgs.size();
 	clang::tooling::CommonOptionsParser optionsParser(clangArgCount, clangArgs.data());
@@ -391,15 +519,29 @@ int main(int argc, char *argv[]) {
 	PipeSummary pSum;
 	std::map<std::string, stageSummary> stageMap;
 
-	for(int i = 1; i <= NUM_CLANG_PASSES; ++i)
-	{
-		pikoTool.run(new PikoActionFactory(&pSum, &stageMap, i));
+	pikoTool.run(new PikoActionFactory(&pSum, &stageMap));
+
+	PikoProfile profile;
+	if(pikocOptions.profileFile != "") {
+		if(!profile.load(pikocOptions.profileFile))
+			return 5;
+		// stages of another pipe may share names with this one's
+		if(profile.pipeName != pSum.name) {
+			llvm::errs() << "Profile " << pikocOptions.profileFile << " was recorded for pipe "
+				<< profile.pipeName << ", not " << pSum.name << "\n";
+			return 5;
+		}
+		pSum.profile = &profile;
 	}
 
+	// A profiling build keeps every stage in its own kernels, so that each
+	// stage's bins and kernel times can be measured separately
+	bool fuseStages = pikocOptions.optimize && pikocOptions.profileGenFile == "";
+
 	//pSum.displaySummary();
 	pSum.generateKernelPlan(std::cout);
 	std::vector< std::vector<stageSummary*> > kernelList =
-		makeKernelList(pSum, pikocOptions.optimize);
+		makeKernelList(pSum, fuseStages);
 
 	if(pSum.stages.size() == 0)
 		return 0;
@@ -413,6 +555,8 @@ int main(int argc, char *argv[]) {
 		}
 	}
 
+	pSum.findExclusiveBins((pikocOptions.target == pikoc::CPU) ? archCPU : archGPU);
+
 	// Emit the pipeline emit functions and the kernels
 	outfile << "//////////////////////////// DEVICE CODE ////////////////////////////\n";
 	generateEmitFunc(pSum, outfile);
@@ -424,6 +568,18 @@ int main(int argc, char *argv[]) {
 	else if(pikocOptions.target == pikoc::CPU)
 		backend = new CPUBackend(pikocOptions, pSum, kernelList);
 
+	if(pikocOptions.headless)
+		outfileDefines << "#define __PIKOC_HEADLESS__\n\n";
+	if(pikocOptions.bench)
+		outfileDefines << "#define __PIKOC_BENCH__\n\n";
+	if(pikocOptions.instrument)
+		outfileDefines << "#define __PIKOC_INSTRUMENT__\n\n";
+	if(pikocOptions.perfCounters)
+		outfileDefines << "#define __PIKOC_PERF_COUNTERS__\n\n";
+	if(pikocOptions.capture)
+		outfileDefines << "#define __PIKOC_CAPTURE__\n\n";
+	generateUserDefines(pikocOptions, outfileDefines);
+	generateExclusiveBinDefines(pSum, outfileDefines);
 	backend->emitDefines(outfileDefines);
 	outfileDefines.flush();
 	outfileDefines.close();
@@ -439,6 +595,11 @@ int main(int argc, char *argv[]) {
 	outfile.flush();
 	outfile.close();
 
+	if(!fixLineDirectives(outFileNameH)) {
+		llvm::errs() << "Unable to rewrite output file " << outFileNameH << "\n";
+		return 4;
+	}
+
 	// Pause here if the user wants to edit __pikoCompiledPipe.h
 	if(pikocOptions.edit)
 		PressEnterToContinue();
@@ -450,7 +611,7 @@ int main(int argc, char *argv[]) {
 	}
 
 	// Optimize LLVM module in backend
-	if(!backend->optimizeLLVMModule(0)) {
+	if(!backend->optimizeLLVMModule(pikocOptions.optLevel)) {
 		llvm::errs() << "Unable to optimize LLVM module for backend code generation\n";
 		exit(1);
 	}
@@ -461,5 +622,10 @@ int main(int argc, char *argv[]) {
 		exit(1);
 	}
 
+	if(useCache)
+		cache.store();
+	if(pikocOptions.cacheStats)
+		cache.printStats();
+
 	delete backend;
 }
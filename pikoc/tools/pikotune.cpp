@@ -0,0 +1,490 @@
+// pikotune: sweeps stage parameters of a Piko pipeline.
+//
+// Every combination of the candidate values in a spec file is passed to the
+// pipeline build as pikoc -D options, built, and run over a set of scenes.
+// The time and peak memory of each variant are recorded and the variants
+// that are Pareto-optimal in (time, memory) are reported.
+//
+// Spec file format, one directive per line, '#' starts a comment:
+//
+//   dir     <directory>         working directory of the build and run commands
+//   build   <command>           build command, $(DEFINES) expands to the -D options
+//   run     <command>           run command, $(SCENE) expands to the scene
+//   scene   <scene>             scene to run, may be repeated (default: one run)
+//   param   <MACRO> <v1> <v2>.. candidate values of a stage parameter macro
+//   metric  <text>              take the time (ms) from the number that follows
+//                               <text> in the run output, and stop the run once
+//                               it has been printed. Default is the wall time.
+//   timeout <seconds>           limit for a single run (default 300)
+//
+// Example for the headless CPU rasterizer:
+//
+//   dir     samples/rasterPipelineFixPt
+//   build   make headless PIKOC_DEFINES="$(DEFINES)"
+//   run     bin/pikoraster-headless $(SCENE) 20
+//   scene   fairyforest.scene
+//   param   VS_BINSIZE 16 32 64
+//   param   VS_THREADCOUNT 128 256 512
+//   metric  Full run time =
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <poll.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+struct TuneParam {
+	std::string name;
+	std::vector<std::string> values;
+};
+
+struct TuneSpec {
+	std::string dir;
+	std::string build;
+	std::string run;
+	std::string metric;
+	std::vector<std::string> scenes;
+	std::vector<TuneParam> params;
+	int timeout;
+
+	TuneSpec() : timeout(300) {}
+};
+
+struct TuneResult {
+	std::string defines;
+	bool ok;
+	double timeMs;    // summed over all scenes
+	long maxRssKB;    // largest over all scenes
+	bool pareto;
+
+	TuneResult() : ok(false), timeMs(0.0), maxRssKB(0), pareto(false) {}
+};
+
+struct RunOutput {
+	bool ok;
+	double timeMs;
+	long maxRssKB;
+};
+
+static double nowMs()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static std::string trim(const std::string& s)
+{
+	size_t b = s.find_first_not_of(" \t\r\n");
+	if(b == std::string::npos)
+		return "";
+	size_t e = s.find_last_not_of(" \t\r\n");
+	return s.substr(b, e - b + 1);
+}
+
+static std::string replaceAll(std::string s, const std::string& from, const std::string& to)
+{
+	size_t pos = 0;
+	while((pos = s.find(from, pos)) != std::string::npos) {
+		s.replace(pos, from.size(), to);
+		pos += to.size();
+	}
+	return s;
+}
+
+static bool parseSpec(const char* filename, TuneSpec& spec)
+{
+	std::ifstream in(filename);
+	if(!in.is_open()) {
+		fprintf(stderr, "Unable to open spec file %s\n", filename);
+		return false;
+	}
+
+	std::string line;
+	int lineNum = 0;
+	while(std::getline(in, line)) {
+		++lineNum;
+
+		size_t hash = line.find('#');
+		if(hash != std::string::npos)
+			line = line.substr(0, hash);
+		line = trim(line);
+		if(line == "")
+			continue;
+
+		std::stringstream ss(line);
+		std::string key;
+		ss >> key;
+		std::string rest;
+		std::getline(ss, rest);
+		rest = trim(rest);
+
+		if(key == "dir")
+			spec.dir = rest;
+		else if(key == "build")
+			spec.build = rest;
+		else if(key == "run")
+			spec.run = rest;
+		else if(key == "metric")
+			spec.metric = rest;
+		else if(key == "scene")
+			spec.scenes.push_back(rest);
+		else if(key == "timeout")
+			spec.timeout = atoi(rest.c_str());
+		else if(key == "param") {
+			TuneParam p;
+			std::stringstream ps(rest);
+			ps >> p.name;
+			std::string v;
+			while(ps >> v)
+				p.values.push_back(v);
+			if(p.name == "" || p.values.empty()) {
+				fprintf(stderr, "%s:%d: param needs a name and at least one value\n",
+					filename, lineNum);
+				return false;
+			}
+			spec.params.push_back(p);
+		}
+		else {
+			fprintf(stderr, "%s:%d: unknown directive '%s'\n", filename, lineNum, key.c_str());
+			return false;
+		}
+	}
+
+	if(spec.build == "" || spec.run == "") {
+		fprintf(stderr, "%s: spec needs a build and a run command\n", filename);
+		return false;
+	}
+	if(spec.params.empty()) {
+		fprintf(stderr, "%s: spec has no parameters to tune\n", filename);
+		return false;
+	}
+	if(spec.scenes.empty())
+		spec.scenes.push_back("");
+
+	return true;
+}
+
+// Runs cmd through the shell in dir. The output is echoed to log. If metric
+// is set, the run stops as soon as the metric has been printed.
+static RunOutput runCommand(const std::string& dir, const std::string& cmd,
+	const std::string& metric, int timeout, FILE* log)
+{
+	RunOutput out;
+	out.ok = false;
+	out.timeMs = 0.0;
+	out.maxRssKB = 0;
+
+	int fds[2];
+	if(pipe(fds) != 0) {
+		perror("pipe");
+		return out;
+	}
+
+	double start = nowMs();
+
+	pid_t pid = fork();
+	if(pid < 0) {
+		perror("fork");
+		close(fds[0]);
+		close(fds[1]);
+		return out;
+	}
+
+	if(pid == 0) {
+		// own process group, so that a stopped run takes its children with it
+		setpgid(0, 0);
+		dup2(fds[1], 1);
+		dup2(fds[1], 2);
+		close(fds[0]);
+		close(fds[1]);
+		if(dir != "" && chdir(dir.c_str()) != 0) {
+			perror(dir.c_str());
+			_exit(127);
+		}
+		execl("/bin/sh", "sh", "-c", cmd.c_str(), (char*) NULL);
+		_exit(127);
+	}
+
+	setpgid(pid, pid);
+	close(fds[1]);
+
+	std::string pending;
+	bool haveMetric = false;
+	bool stopped = false;
+	char buf[4096];
+
+	while(true) {
+		int left = (int) (timeout * 1000.0 - (nowMs() - start));
+		if(left <= 0) {
+			fprintf(stderr, "  run timed out after %d s\n", timeout);
+			kill(-pid, SIGKILL);
+			stopped = true;
+			break;
+		}
+
+		struct pollfd pfd;
+		pfd.fd = fds[0];
+		pfd.events = POLLIN;
+		int r = poll(&pfd, 1, left);
+		if(r < 0 && errno == EINTR)
+			continue;
+		if(r <= 0)
+			continue;
+
+		ssize_t n = read(fds[0], buf, sizeof(buf));
+		if(n <= 0)
+			break;
+
+		if(log)
+			fwrite(buf, 1, n, log);
+
+		if(metric == "")
+			continue;
+
+		pending.append(buf, n);
+		size_t nl;
+		while((nl = pending.find('\n')) != std::string::npos) {
+			std::string line = pending.substr(0, nl);
+			pending.erase(0, nl + 1);
+
+			size_t pos = line.find(metric);
+			if(pos != std::string::npos) {
+				out.timeMs = atof(line.c_str() + pos + metric.size());
+				haveMetric = true;
+			}
+		}
+
+		// Interactive samples keep running after they print their timings
+		if(haveMetric) {
+			kill(-pid, SIGTERM);
+			stopped = true;
+			break;
+		}
+	}
+
+	close(fds[0]);
+
+	int status = 0;
+	struct rusage usage;
+	while(wait4(pid, &status, 0, &usage) < 0 && errno == EINTR)
+		;
+
+	// ru_maxrss is in kilobytes on Linux
+	out.maxRssKB = usage.ru_maxrss;
+
+	if(metric == "") {
+		out.timeMs = nowMs() - start;
+		out.ok = !stopped && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+	}
+	else {
+		out.ok = haveMetric;
+		if(!haveMetric)
+			fprintf(stderr, "  run did not print '%s'\n", metric.c_str());
+	}
+
+	return out;
+}
+
+static std::string definesFor(const TuneSpec& spec, const std::vector<int>& choice)
+{
+	std::string defines;
+	for(unsigned i = 0; i < spec.params.size(); ++i) {
+		if(i > 0)
+			defines += " ";
+		defines += "-D" + spec.params[i].name + "=" + spec.params[i].values[choice[i]];
+	}
+	return defines;
+}
+
+// Advances choice to the next point of the Cartesian product
+static bool nextChoice(const TuneSpec& spec, std::vector<int>& choice)
+{
+	for(unsigned i = 0; i < choice.size(); ++i) {
+		if(++choice[i] < (int) spec.params[i].values.size())
+			return true;
+		choice[i] = 0;
+	}
+	return false;
+}
+
+static void markPareto(std::vector<TuneResult>& results)
+{
+	for(unsigned i = 0; i < results.size(); ++i) {
+		if(!results[i].ok)
+			continue;
+
+		results[i].pareto = true;
+		for(unsigned j = 0; j < results.size(); ++j) {
+			if(i == j || !results[j].ok)
+				continue;
+
+			bool noWorse = results[j].timeMs <= results[i].timeMs
+			            && results[j].maxRssKB <= results[i].maxRssKB;
+			bool better  = results[j].timeMs < results[i].timeMs
+			            || results[j].maxRssKB < results[i].maxRssKB;
+			if(noWorse && better) {
+				results[i].pareto = false;
+				break;
+			}
+		}
+	}
+}
+
+static void printUsage()
+{
+	fprintf(stderr, "\n");
+	fprintf(stderr, "Usage: pikotune [options] <spec file>\n\n");
+	fprintf(stderr, "Options:\n");
+	fprintf(stderr, "  -h, --help            Prints this help message\n");
+	fprintf(stderr, "  --log=<file>          Write build and run output to file (default is pikotune.log)\n");
+	fprintf(stderr, "  --dry-run             Print the variants without building them\n");
+	fprintf(stderr, "\n");
+}
+
+int main(int argc, char* argv[])
+{
+	std::string logName = "pikotune.log";
+	bool dryRun = false;
+
+	int i;
+	for(i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+
+		if(arg.substr(0, 1) != "-")
+			break;
+
+		if(arg == "-h" || arg == "--help") {
+			printUsage();
+			return 0;
+		}
+		else if(arg.substr(0, 6) == "--log=") {
+			logName = arg.substr(6);
+		}
+		else if(arg == "--dry-run") {
+			dryRun = true;
+		}
+		else {
+			fprintf(stderr, "\nInvalid commandline options: %s\n", arg.c_str());
+			printUsage();
+			return 10;
+		}
+	}
+
+	if(i != argc - 1) {
+		printUsage();
+		return 10;
+	}
+
+	TuneSpec spec;
+	if(!parseSpec(argv[i], spec))
+		return 1;
+
+	int numVariants = 1;
+	for(unsigned p = 0; p < spec.params.size(); ++p)
+		numVariants *= spec.params[p].values.size();
+
+	FILE* log = NULL;
+	if(!dryRun) {
+		log = fopen(logName.c_str(), "w");
+		if(!log) {
+			fprintf(stderr, "Unable to open log file %s\n", logName.c_str());
+			return 1;
+		}
+	}
+
+	std::vector<TuneResult> results;
+	std::vector<int> choice(spec.params.size(), 0);
+	int variant = 0;
+
+	do {
+		TuneResult res;
+		res.defines = definesFor(spec, choice);
+		++variant;
+
+		printf("[%d/%d] %s\n", variant, numVariants, res.defines.c_str());
+		fflush(stdout);
+
+		if(dryRun)
+			continue;
+
+		std::string build = replaceAll(spec.build, "$(DEFINES)", res.defines);
+		fprintf(log, "==== %s\n$ %s\n", res.defines.c_str(), build.c_str());
+		fflush(log);
+
+		RunOutput b = runCommand(spec.dir, build, "", spec.timeout, log);
+		if(!b.ok) {
+			printf("  build failed, see %s\n", logName.c_str());
+			results.push_back(res);
+			continue;
+		}
+
+		res.ok = true;
+		for(unsigned s = 0; s < spec.scenes.size(); ++s) {
+			std::string run = replaceAll(spec.run, "$(SCENE)", spec.scenes[s]);
+			fprintf(log, "$ %s\n", run.c_str());
+			fflush(log);
+
+			RunOutput r = runCommand(spec.dir, run, spec.metric, spec.timeout, log);
+			if(!r.ok) {
+				printf("  run failed on %s, see %s\n", spec.scenes[s].c_str(), logName.c_str());
+				res.ok = false;
+				break;
+			}
+
+			res.timeMs += r.timeMs;
+			if(r.maxRssKB > res.maxRssKB)
+				res.maxRssKB = r.maxRssKB;
+		}
+
+		if(res.ok)
+			printf("  %.2f ms, %.1f MB\n", res.timeMs, res.maxRssKB / 1024.0);
+		fflush(stdout);
+
+		results.push_back(res);
+	} while(nextChoice(spec, choice));
+
+	if(log)
+		fclose(log);
+
+	if(dryRun)
+		return 0;
+
+	markPareto(results);
+
+	int best = -1;
+	printf("\n");
+	printf("Pareto-optimal configurations (time over %d scene(s), peak memory):\n",
+		(int) spec.scenes.size());
+	for(unsigned r = 0; r < results.size(); ++r) {
+		if(!results[r].pareto)
+			continue;
+
+		printf("  %10.2f ms  %8.1f MB  %s\n", results[r].timeMs,
+			results[r].maxRssKB / 1024.0, results[r].defines.c_str());
+
+		if(best < 0 || results[r].timeMs < results[best].timeMs)
+			best = r;
+	}
+
+	if(best < 0) {
+		printf("  none: no variant built and ran successfully\n");
+		return 1;
+	}
+
+	printf("\n");
+	printf("Fastest: PIKOC_DEFINES=\"%s\"\n", results[best].defines.c_str());
+
+	return 0;
+}